@@ -1,20 +1,213 @@
 #ifndef ANYWHERE_DEQUE_HPP
 #define ANYWHERE_DEQUE_HPP
 
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+#include <boost/config.hpp>
+#ifndef BOOST_NO_CXX11_HDR_THREAD
+#include <exception>
+#include <functional>
+#include <thread>
+#endif
 #include <boost/iterator/iterator_facade.hpp>
+#include <boost/move/utility_core.hpp>
 #include <boost/operators.hpp>
-#include <boost/tuple/tuple.hpp>
+#include <boost/range/iterator_range.hpp>
+#include <boost/type_traits/remove_cv.hpp>
+#include <boost/type_traits/remove_reference.hpp>
+#include <boost/utility/result_of.hpp>
+#include <boost/type_traits/integral_constant.hpp>
+#include <boost/type_traits/is_integral.hpp>
+#include <boost/type_traits/is_nothrow_move_constructible.hpp>
 #include "slidable_map.hpp"
 
 namespace gununu {
-template <class T, class Allocator>
+template <class T, class Allocator, class Weight, class KeyStorage>
 class anywhere_deque;
+template <class Allocator, std::size_t ChunkSize>
+class anywhere_string;
 
 namespace detail {
+// lazy reversal of subtrees
+struct reverse_augment : no_augment {
+    struct data {
+        data() : reversed(false) {}
+        bool reversed;
+    };
+    static const bool lazy = true;
+
+    template <class Node>
+    static void reverse(Node* p) {
+        p->aug.reversed = !p->aug.reversed;
+    }
+    template <class Node>
+    static void push(Node* p) {
+        if (!p->aug.reversed)
+            return;
+        p->aug.reversed = false;
+        std::swap(p->left, p->right);
+        if (p->left) {
+            p->left->key = -p->left->key;
+            reverse(p->left);
+        }
+        if (p->right) {
+            p->right->key = -p->right->key;
+            reverse(p->right);
+        }
+    }
+};
+
+// lazy reversal and sum of the weights of subtrees
+template <class T, class Weight>
+struct weight_augment : reverse_augment {
+    typedef typename boost::remove_cv<typename boost::remove_reference<
+        typename boost::result_of<const Weight(const T&)>::type>::type>::type weight_type;
+    struct data {
+        data() : reversed(false), sum() {}
+        bool reversed;
+        weight_type sum;
+    };
+    static const bool aggregate = true;
+
+    template <class Node>
+    static void update(Node* p) {
+        weight_type sum = Weight()(p->value());
+        if (p->left)
+            sum = p->left->aug.sum + sum;
+        if (p->right)
+            sum = sum + p->right->aug.sum;
+        p->aug.sum = sum;
+    }
+};
+
+struct no_weight {};
+
+struct weight_less {
+    template <class W>
+    bool operator () (const W& x, const W& w) const { return x < w; }
+};
+
+template <class T, class Weight>
+struct deque_augment {
+    typedef weight_augment<T, Weight> type;
+    typedef typename type::weight_type weight_type;
+};
+template <class T>
+struct deque_augment<T, void> {
+    typedef reverse_augment type;
+    typedef no_weight weight_type;
+};
+
+#ifndef BOOST_NO_CXX11_HDR_THREAD
+// runs the tasks on their own threads and rethrows the first exception.
+// if a thread cannot be started, the tasks left are run on this thread.
+inline void run_parallel(std::vector<std::function<void()> >& tasks) {
+    std::vector<std::exception_ptr> errors(tasks.size());
+    std::vector<std::thread> threads;
+    // push_back never throws below, so a started thread is always joined
+    threads.reserve(tasks.size());
+    std::size_t started = 1;
+    try {
+        for (; started < tasks.size(); ++started) {
+            std::function<void()>& task = tasks[started];
+            std::exception_ptr& error = errors[started];
+            threads.push_back(std::thread([&task, &error]() {
+                try {
+                    task();
+                } catch (...) {
+                    error = std::current_exception();
+                }
+            }));
+        }
+    } catch (...) {
+        // std::system_error from std::thread. nothing was started for tasks[started].
+    }
+    const auto run = [&tasks, &errors](std::size_t i) {
+        try {
+            tasks[i]();
+        } catch (...) {
+            errors[i] = std::current_exception();
+        }
+    };
+    run(0);
+    for (std::size_t i = started; i < tasks.size(); ++i)
+        run(i);
+    for (std::size_t i = 0; i < threads.size(); ++i)
+        threads[i].join();
+    for (std::size_t i = 0; i < errors.size(); ++i)
+        if (errors[i])
+            std::rethrow_exception(errors[i]);
+}
+#endif
+
+// sorts the parts of [first,last) on threads and merges them pairwise on threads.
+// std::inplace_merge is stable, so it is stable if 'stable' is true.
+template <class RandomIt, class Compare>
+void parallel_sort(RandomIt first, RandomIt last, Compare comp, bool stable) {
+    const std::size_t n = last - first;
+    std::size_t parts = 1;
+#ifndef BOOST_NO_CXX11_HDR_THREAD
+    const std::size_t min_part = 1 << 14;
+    parts = (std::min)(std::size_t(std::thread::hardware_concurrency()), n / min_part);
+#endif
+    if (parts < 2) {
+        if (stable)
+            std::stable_sort(first, last, comp);
+        else
+            std::sort(first, last, comp);
+        return;
+    }
+#ifndef BOOST_NO_CXX11_HDR_THREAD
+    std::vector<RandomIt> bounds;
+    for (std::size_t i = 0; i < parts; ++i)
+        bounds.push_back(first + n * i / parts);
+    bounds.push_back(last);
+
+    std::vector<std::function<void()> > tasks;
+    for (std::size_t i = 0; i < parts; ++i) {
+        const RandomIt b = bounds[i], e = bounds[i + 1];
+        if (stable)
+            tasks.push_back([b, e, comp]() { std::stable_sort(b, e, comp); });
+        else
+            tasks.push_back([b, e, comp]() { std::sort(b, e, comp); });
+    }
+    run_parallel(tasks);
+
+    while (bounds.size() > 2) {
+        tasks.clear();
+        std::vector<RandomIt> merged;
+        std::size_t i = 0;
+        for (; i + 2 < bounds.size(); i += 2) {
+            const RandomIt b = bounds[i], m = bounds[i + 1], e = bounds[i + 2];
+            tasks.push_back([b, m, e, comp]() { std::inplace_merge(b, m, e, comp); });
+            merged.push_back(b);
+        }
+        for (; i < bounds.size(); ++i)
+            merged.push_back(bounds[i]);
+        run_parallel(tasks);
+        bounds.swap(merged);
+    }
+#endif
+}
+
+// yields the same value forever
+template <class T>
+class repeat_iterator {
+public:
+    explicit repeat_iterator(const T& v) : val(&v) {}
+    const T& operator * () const { return *val; }
+    repeat_iterator& operator ++ () { return *this; }
+private:
+    const T* val;
+};
+
 template <class Map, class Value, class Ref>
 class iterator_base : public boost::iterator_facade<iterator_base<Map,Value,Ref>, Value, boost::random_access_traversal_tag, Ref> {
     friend class boost::iterator_core_access;
-    template <class,class> friend class anywhere_deque;
+    friend class segment_access;
+    template <class,class,class,class> friend class ::gununu::anywhere_deque;
+    template <class,std::size_t> friend class ::gununu::anywhere_string;
     template <class,class,class> friend class iterator_base;
 public:
     template <class M, class R>
@@ -53,12 +246,125 @@ private:
     Map* map;
     std::size_t index;
 };
+
+// gives the node-walking algorithms access to the container behind an iterator.
+// a container walks its nodes in order and passes fn the elements of each node as a range:
+// one element for anywhere_deque, and the bytes of a chunk for anywhere_string.
+class segment_access {
+public:
+    template <class Map, class Value, class Ref>
+    static Map& container(const iterator_base<Map,Value,Ref>& it) {
+        assert(it.map);
+        return *it.map;
+    }
+    template <class Map, class Value, class Ref>
+    static std::size_t index(const iterator_base<Map,Value,Ref>& it) {
+        return it.index;
+    }
+    // calls fn(boost::iterator_range<T*>) for the elements of each node in [first,last) while it
+    // returns true. returns the index of the element where it stopped.
+    template <class Map, class Fn>
+    static std::size_t walk(Map& m, std::size_t first, std::size_t last, Fn& fn) {
+        return m.walk(first, last, fn);
+    }
+};
+
+template <class Fn>
+struct segment_for_each {
+    explicit segment_for_each(Fn& f) : fn(f) {}
+    template <class Range>
+    bool operator () (const Range& r) {
+        fn(r);
+        return true;
+    }
+    Fn& fn;
+};
+
+// calls fn for every element of the ranges
+template <class Fn>
+struct element_for_each {
+    explicit element_for_each(Fn& f) : fn(f) {}
+    template <class Range>
+    bool operator () (const Range& r) {
+        for (typename Range::iterator p = r.begin(); p != r.end(); ++p)
+            fn(*p);
+        return true;
+    }
+    Fn& fn;
+};
+
+template <class OutputIt>
+struct segment_copy {
+    explicit segment_copy(OutputIt o) : out(o) {}
+    template <class Range>
+    bool operator () (const Range& r) {
+        out = std::copy(r.begin(), r.end(), out);
+        return true;
+    }
+    OutputIt out;
+};
+
+template <class U>
+struct segment_fill {
+    explicit segment_fill(const U& v) : val(v) {}
+    template <class Range>
+    bool operator () (const Range& r) {
+        std::fill(r.begin(), r.end(), val);
+        return true;
+    }
+    const U& val;
+};
+
+template <class U>
+struct segment_find {
+    explicit segment_find(const U& v) : val(v), offset(0) {}
+    template <class Range>
+    bool operator () (const Range& r) {
+        offset = std::find(r.begin(), r.end(), val) - r.begin();
+        return offset == static_cast<std::size_t>(r.size());
+    }
+    const U& val;
+    std::size_t offset;
+};
+
+template <class U, class BinaryOp>
+struct segment_accumulate {
+    segment_accumulate(const U& init, BinaryOp o) : sum(init), op(o) {}
+    template <class Range>
+    bool operator () (const Range& r) {
+        sum = std::accumulate(r.begin(), r.end(), sum, op);
+        return true;
+    }
+    U sum;
+    BinaryOp op;
+};
 }
 
-template <class T, class Allocator = std::allocator<T> >
+// an edit for anywhere_deque::apply_edits().
+// erases 'erase' elements from 'index' and inserts [first,last) there.
+template <class ForwardIt>
+struct edit_op {
+    std::size_t index;
+    std::size_t erase;
+    ForwardIt first;
+    ForwardIt last;
+};
+
+template <class ForwardIt>
+edit_op<ForwardIt> make_edit(std::size_t index, std::size_t erase, ForwardIt first, ForwardIt last) {
+    edit_op<ForwardIt> e = {index, erase, first, last};
+    return e;
+}
+
+// Weight is a default constructible function object that returns the weight of an element.
+// if it is given, the sum of weights of every subtree is kept for find_by_weight() and prefix_weight().
+// KeyStorage is the KeyStorage policy of the tree. a relative key is at most the number of elements,
+// so narrow_keys<boost::int32_t> makes the nodes smaller on 64 bit platforms and limits max_size() to 2^30.
+template <class T, class Allocator = std::allocator<T>, class Weight = void, class KeyStorage = wide_keys>
 class anywhere_deque : 
         private Allocator ,
-        private boost::totally_ordered<anywhere_deque<T,Allocator> > {
+        private boost::totally_ordered<anywhere_deque<T,Allocator,Weight,KeyStorage> > {
+    friend class detail::segment_access;
 public:
     typedef detail::iterator_base<anywhere_deque, T, T&> iterator;
     typedef detail::iterator_base<const anywhere_deque, T, const T&> const_iterator;
@@ -73,53 +379,75 @@ public:
     typedef Allocator allocator_type;
     typedef std::size_t size_type;
     typedef std::ptrdiff_t difference_type;
+    typedef typename detail::deque_augment<T, Weight>::weight_type weight_type;
     
-    explicit anywhere_deque(const Allocator& a = Allocator()):Allocator(a),map(a){}
-    anywhere_deque(const anywhere_deque& r) : Allocator(r), map(r.map) {}
-    anywhere_deque(const anywhere_deque& r, const Allocator& a) : Allocator(a), map(r.map, a) {}
+    explicit anywhere_deque(const Allocator& a = Allocator()):Allocator(a),map(a),gapbuf(a),gapindex(0),gaplimit(0){}
+    anywhere_deque(const anywhere_deque& r) : Allocator(r), map(r.map), gapbuf(r.get_allocator()), gapindex(r.gapindex), gaplimit(r.gaplimit) {
+        gapbuf.reserve(gaplimit);
+        gapbuf.assign(r.gapbuf.begin(), r.gapbuf.end());
+    }
+    anywhere_deque(const anywhere_deque& r, const Allocator& a) : Allocator(a), map(r.map, a), gapbuf(a), gapindex(r.gapindex), gaplimit(r.gaplimit) {
+        gapbuf.reserve(gaplimit);
+        gapbuf.assign(r.gapbuf.begin(), r.gapbuf.end());
+    }
 #ifndef BOOST_NO_RVALUE_REFERENCES
-    anywhere_deque(anywhere_deque&& r) : Allocator(std::move(r)), map(std::move(r.map)){}
-    anywhere_deque(anywhere_deque&& r, const Allocator& a) : Allocator(a), map(std::move(r.map), a){}
+    // the gap is moved as it is, so a move neither allocates nor flushes
+    anywhere_deque(anywhere_deque&& r) : Allocator(std::move(r)), map(std::move(r.map)), gapbuf(std::move(r.gapbuf)), gapindex(r.gapindex), gaplimit(r.gaplimit){}
+    anywhere_deque(anywhere_deque&& r, const Allocator& a) : Allocator(a), map(std::move(r.map), a), gapbuf(std::move(r.gapbuf), a), gapindex(r.gapindex), gaplimit(r.gaplimit){}
 #endif
-    anywhere_deque(size_type count, const value_type& val, const Allocator& a = Allocator()) : Allocator(a), map(a) {
-            size_type i=size_type();
-            for (; i < count; ++i)
-                push_back(val);
+    anywhere_deque(size_type count, const value_type& val, const Allocator& a = Allocator()) : Allocator(a), map(a), gapbuf(a), gapindex(0), gaplimit(0) {
+        map.assign_sequence(detail::repeat_iterator<T>(val), count);
     }
-    explicit anywhere_deque(size_type count) {
-        size_type i=size_type();
-        for (; i < count; ++i)
-            push_back(value_type());
+    explicit anywhere_deque(size_type count) : gapindex(0), gaplimit(0) {
+        const value_type val = value_type();
+        map.assign_sequence(detail::repeat_iterator<T>(val), count);
     }
 
     template <class InputIt>
-    anywhere_deque(InputIt first, InputIt last, const Allocator& a = Allocator()) : Allocator(a), map(a) {
-        for (; first != last; ++first)
-            push_back(*first);
+    anywhere_deque(InputIt first, InputIt last, const Allocator& a = Allocator()) : Allocator(a), map(a), gapbuf(a), gapindex(0), gaplimit(0) {
+        assign_dispatch(first, last, typename boost::is_integral<InputIt>::type());
     }
 
 #ifndef BOOST_NO_UNIFIED_INITIALIZETION_SYNTAX
-    anywhere_deque(std::initializer_list<T> list, const Allocator& a = Allocator()) : Allocator(a), map(a) {
-        for (auto& v : list)
-            push_back(v);
+    anywhere_deque(std::initializer_list<T> list, const Allocator& a = Allocator()) : Allocator(a), map(a), gapbuf(a), gapindex(0), gaplimit(0) {
+        map.assign_sequence(list.begin(), list.size());
     }
 #endif    
     void assign(size_type count, const value_type& val) {
-        map_type tmp;
-        size_type i = size_type();
-        for (; i<count; ++i)
-            tmp.push_back(val);
-        swap(tmp);
+        gapbuf.clear();
+        map.assign_sequence(detail::repeat_iterator<T>(val), count);
     }
     template <class InputIt>
     void assign(InputIt first, InputIt last) {
-        map_type tmp;
-        for (;first != last; ++first)
-            tmp.push_back(*first);
-        swap(tmp);
+        assign_dispatch(first, last, typename boost::is_integral<InputIt>::type());
+    }
+#ifndef BOOST_NO_UNIFIED_INITIALIZETION_SYNTAX
+    void assign(std::initializer_list<T> list) {
+        gapbuf.clear();
+        map.assign_sequence(list.begin(), list.size());
+    }
+#endif
+
+    void resize(size_type count) {
+        resize(count, value_type());
+    }
+    void resize(size_type count, const value_type& val) {
+        flush();
+        if (count < size()) {
+            map_type tail(map.get_allocator());
+            map.split_at(count, tail, size() - count);
+        } else if (size() < count) {
+            map_type piece(map.get_allocator());
+            piece.assign_sequence(detail::repeat_iterator<T>(val), count - size());
+            paste(size(), piece);
+        }
     }
 
     void push_back(const value_type& val) {
+        if (gaplimit) {
+            insert(end(), val);
+            return;
+        }
         if (empty()) {
             map.insert(std::make_pair(map.size(), val));
         } else {
@@ -128,6 +456,10 @@ public:
     }
 #ifndef BOOST_NO_RVALUE_REFERENCES
     void push_back(value_type&& val) {
+        if (gaplimit) {
+            insert(end(), std::move(val));
+            return;
+        }
         if (empty()) {
             map.insert(std::make_pair(map.size(), std::move(val)));
         } else {
@@ -136,6 +468,7 @@ public:
     }
 #endif
     void push_front(const value_type& val) {
+        flush();
         map.slide_all(+1);
         try {
             if (empty()) {
@@ -150,6 +483,7 @@ public:
     }
 #ifndef BOOST_NO_RVALUE_REFERENCES
     void push_front(value_type&& val) {
+        flush();
         map.slide_all(+1);
         try {
             if (empty()) {
@@ -165,15 +499,21 @@ public:
 #endif
     void pop_back() {
         assert(!empty());
+        flush();
         map.erase(--map.end());
     }
     void pop_front() {
         assert(!empty());
+        flush();
         map.erase(map.begin());
         map.slide_all(-1);
     }
     iterator insert(const_iterator pos, const value_type& val) {
         assert(pos.map == this && pos.index <= size());
+        if (into_gap(pos.index)) {
+            gapbuf.insert(gapbuf.begin() + (pos.index - gapindex), val);
+            return iterator(this,pos.index);
+        }
         map.slide_rightkeys(pos.index, +1);
         try {
             map.insert(std::make_pair(pos.index, val));
@@ -186,6 +526,10 @@ public:
 #ifndef BOOST_NO_RVALUE_REFERENCES
     iterator insert(const_iterator pos, value_type&& val) {
         assert(pos.map == this && pos.index <= size());
+        if (into_gap(pos.index)) {
+            gapbuf.insert(gapbuf.begin() + (pos.index - gapindex), std::move(val));
+            return iterator(this,pos.index);
+        }
         map.slide_rightkeys(pos.index, +1);
         try {
             map.insert(std::make_pair(pos.index, std::move(val)));
@@ -209,21 +553,21 @@ public:
 #endif
     iterator insert(const_iterator pos, size_type count, const value_type& val) {
         assert(pos.map == this && pos.index <= size());
-        size_type r = pos.index;
-        try {
-            for (size_type i=0; i < count; ++i, ++pos)
-                insert(pos, val);
-        } catch (...) {
-            erase(iterator(this,r), pos);
-            throw;
-        }
-
-        return iterator(this, r);
+        flush();
+        map_type piece(map.get_allocator());
+        piece.assign_sequence(detail::repeat_iterator<T>(val), count);
+        paste(pos.index, piece);
+        return iterator(this, pos.index);
     }
     
 
     iterator erase(const_iterator pos) {
         assert(pos.map == this && pos.index < size());
+        if (!gapbuf.empty() && gapindex <= pos.index && pos.index - gapindex < gapbuf.size()) {
+            gapbuf.erase(gapbuf.begin() + (pos.index - gapindex));
+            return iterator(this,pos.index);
+        }
+        flush();
         map.erase(pos.index);
         map.slide_rightkeys(pos.index, -1);
         return iterator(this,pos.index);
@@ -232,6 +576,7 @@ public:
         assert(first.map == this && last.map == this && first.index <= last.index && last.index <= size());
         if (first == last)
             return iterator(this,first.index);
+        flush();
         typename map_type::iterator pos = map.find(first.index);
         size_type i=first.index;
         do {
@@ -240,10 +585,172 @@ public:
         map.slide_rightkeys(first.index, first-last);
         return iterator(this,first.index);
     }
-    
+
+    anywhere_deque split(const_iterator pos) {
+        assert(pos.map == this && pos.index <= size());
+        flush();
+        anywhere_deque ret(get_allocator());
+        map.split_at(pos.index, ret.map, size() - pos.index);
+        ret.map.slide_all(-difference_type(pos.index));
+        return ret;
+    }
+
+    void concat(anywhere_deque& other) {
+        assert(&other != this);
+        flush();
+        other.flush();
+        other.map.slide_all(difference_type(size()));
+        try {
+            map.concat(other.map);
+        } catch (...) {
+            other.map.slide_all(-difference_type(size()));
+            throw;
+        }
+    }
+
+    // returns the element that covers x when the weights are laid end to end from the front.
+    // end() if x is not less than total_weight(). weights must not be negative.
+    iterator find_by_weight(const weight_type& x) {
+        return iterator(this, index_by_weight(x, detail::weight_less()));
+    }
+    const_iterator find_by_weight(const weight_type& x) const {
+        return const_iterator(this, index_by_weight(x, detail::weight_less()));
+    }
+    // comp(x, w) has to return true if x is less than w.
+    template <class Compare>
+    iterator find_by_weight(const weight_type& x, Compare comp) {
+        return iterator(this, index_by_weight(x, comp));
+    }
+    template <class Compare>
+    const_iterator find_by_weight(const weight_type& x, Compare comp) const {
+        return const_iterator(this, index_by_weight(x, comp));
+    }
+    // returns the sum of weights of [0, index)
+    weight_type prefix_weight(size_type index) const {
+        assert(index <= size());
+        if (gapbuf.empty() || index <= gapindex)
+            return map_prefix_weight(index);
+        if (index - gapindex <= gapbuf.size())
+            return map_prefix_weight(gapindex) + gap_weight(index - gapindex);
+        return map_prefix_weight(index - gapbuf.size()) + gap_weight(gapbuf.size());
+    }
+    weight_type total_weight() const {
+        const weight_type sum = map.root ? map.root->aug.sum : weight_type();
+        return gapbuf.empty() ? sum : sum + gap_weight(gapbuf.size());
+    }
+    // call this after the weight of an element was changed through a reference.
+    void reweigh(const_iterator pos) {
+        assert(pos.index < size());
+        flush();
+        map_type::updatepath(map.findnode(pos.index, true));
+    }
+
+    void reverse(const_iterator first, const_iterator last) {
+        assert(first.map == this && last.map == this && first.index <= last.index && last.index <= size());
+        if (last.index - first.index < 2)
+            return;
+        flush();
+        map_type piece(map.get_allocator());
+        cut(first.index, last.index, piece);
+        piece.reflect(difference_type(last.index - first.index - 1));
+        paste(first.index, piece);
+    }
+
+    iterator rotate(const_iterator first, const_iterator mid, const_iterator last) {
+        assert(first.map == this && mid.map == this && last.map == this);
+        assert(first.index <= mid.index && mid.index <= last.index && last.index <= size());
+        splice(first, *this, mid, last);
+        return iterator(this, first.index + (last.index - mid.index));
+    }
+
+    void splice(const_iterator pos, anywhere_deque& other, const_iterator first, const_iterator last) {
+        assert(pos.map == this && pos.index <= size());
+        assert(first.map == &other && last.map == &other && first.index <= last.index && last.index <= other.size());
+        if (first == last)
+            return;
+        size_type index = pos.index;
+        if (&other == this) {
+            if (first.index <= index && index <= last.index)
+                return;
+            if (last.index < index)
+                index -= last.index - first.index;
+        } else {
+            // checked before other is cut, so that nothing is lost
+            checkgrowth(size(), last.index - first.index);
+        }
+        flush();
+        other.flush();
+        if (!(get_allocator() == other.get_allocator())) {
+            insert(pos, first, last);
+            other.erase(first, last);
+            return;
+        }
+        map_type piece(map.get_allocator());
+        other.cut(first.index, last.index, piece);
+        paste(index, piece);
+    }
+
+    // applies edit_ops whose indices are of the original sequence.
+    // they have to be sorted by index and must not overlap.
+    // all inserted elements are built first, then the tree is cut and joined in one pass.
+    template <class EditIt>
+    void apply_edits(EditIt first, EditIt last) {
+        flush();
+        map_type ins(map.get_allocator());
+        size_type prev = 0;
+        for (EditIt e = first; e != last; ++e) {
+            assert(prev <= e->index && e->erase <= size() - e->index);
+            prev = e->index + e->erase;
+            map_type piece(map.get_allocator());
+            piece.assign_sequence(e->first, std::distance(e->first, e->last));
+            piece.slide_all(difference_type(ins.size()));
+            ins.concat(piece);
+        }
+        size_type erased = 0;
+        for (EditIt e = first; e != last; ++e)
+            erased += e->erase;
+        checkgrowth(size() - erased, ins.size());
+
+        map_type result(map.get_allocator());
+        size_type done = 0;
+        for (; first != last; ++first) {
+            move_front(map, first->index - done, result);
+            done = first->index;
+            map_type dropped(map.get_allocator());
+            move_front(map, first->erase, dropped);
+            done += first->erase;
+            move_front(ins, std::distance(first->first, first->last), result);
+        }
+        move_front(map, map.size(), result);
+        map.swap(result);
+    }
+
+    // the values are moved out to a buffer in O(N), sorted on threads, and moved back
+    // into the same nodes in O(N). the tree keeps its shape since the indices do not change.
+    void sort() {
+        sort(std::less<value_type>());
+    }
+    template <class Compare>
+    void sort(Compare comp) {
+        sort_impl(comp, false);
+    }
+    void stable_sort() {
+        stable_sort(std::less<value_type>());
+    }
+    template <class Compare>
+    void stable_sort(Compare comp) {
+        sort_impl(comp, true);
+    }
+
     anywhere_deque& operator = (const anywhere_deque& rhs) {
         *static_cast<Allocator*>(this) = rhs;
+        std::vector<T, Allocator> buf(get_allocator());
+        buf.reserve(rhs.gaplimit);
+        buf.assign(rhs.gapbuf.begin(), rhs.gapbuf.end());
         map = rhs.map;
+        gapbuf.swap(buf);
+        gapindex = rhs.gapindex;
+        gaplimit = rhs.gaplimit;
         return *this;
     }
     
@@ -251,39 +758,61 @@ public:
     anywhere_deque& operator = (anywhere_deque&& rhs) {
         *static_cast<Allocator*>(this) = std::move(rhs);
         map = std::move(rhs.map);
+        gapbuf = std::move(rhs.gapbuf);
+        gapindex = rhs.gapindex;
+        gaplimit = rhs.gaplimit;
         return *this;
     }
 #endif
     
     reference operator [] (size_type index) {
         assert(index < size());
-        return map.at(index);
+        return at(index);
     }
     const_reference operator [] (size_type index) const {
         assert(index < size());
-        return map.at(index);
+        return at(index);
     }
+    // the elements in the gap are read without flushing it
     reference at(size_type index) {
+        if (!gapbuf.empty() && gapindex <= index) {
+            if (index - gapindex < gapbuf.size())
+                return gapbuf[index - gapindex];
+            index -= gapbuf.size();
+        }
         return map.at(index);
     }
     const_reference at(size_type index) const {
+        if (!gapbuf.empty() && gapindex <= index) {
+            if (index - gapindex < gapbuf.size())
+                return gapbuf[index - gapindex];
+            index -= gapbuf.size();
+        }
         return map.at(index);
     }
 
     reference front() {
         assert(!empty());
+        if (!gapbuf.empty() && !gapindex)
+            return gapbuf.front();
         return map.begin()->second();
     }
     const_reference front() const {
         assert(!empty());
+        if (!gapbuf.empty() && !gapindex)
+            return gapbuf.front();
         return map.begin()->second();
     }
     reference back() {
         assert(!empty());
+        if (!gapbuf.empty() && gapindex == map.size())
+            return gapbuf.back();
         return map.rbegin()->second();
     }
     const_reference back() const {
         assert(!empty());
+        if (!gapbuf.empty() && gapindex == map.size())
+            return gapbuf.back();
         return map.rbegin()->second();
     }
     
@@ -325,16 +854,19 @@ public:
     }
     
     void clear() {
+        gapbuf.clear();
         map.clear();
     }
 
     size_type size() const {
-        return map.size();
+        return map.size() + gapbuf.size();
     }
     bool empty() const {
-        return map.empty();
+        return map.empty() && gapbuf.empty();
     }
     size_type max_size() const {
+        if (KeyStorage::narrow)
+            return (std::min)(Allocator::max_size(), size_type(KeyStorage::template max_key<difference_type>()) + 1);
         return Allocator::max_size();
     }
     allocator_type get_allocator() const {
@@ -343,44 +875,312 @@ public:
     
     void swap(anywhere_deque& other) {
         map.swap(other.map);
+        gapbuf.swap(other.gapbuf);
+        std::swap(gapindex, other.gapindex);
+        std::swap(gaplimit, other.gaplimit);
     }
     
     friend bool operator == (const anywhere_deque& lhs, const anywhere_deque& rhs) {
-        return lhs.map == rhs.map;
+        if (lhs.gapbuf.empty() && rhs.gapbuf.empty())
+            return lhs.map == rhs.map;
+        return lhs.size() == rhs.size() && std::equal(lhs.obegin(), lhs.oend(), rhs.obegin());
     }
     friend bool operator < (const anywhere_deque& lhs, const anywhere_deque& rhs) {
-        return lhs.map < rhs.map;
+        if (lhs.gapbuf.empty() && rhs.gapbuf.empty())
+            return lhs.map < rhs.map;
+        return std::lexicographical_compare(lhs.obegin(), lhs.oend(), rhs.obegin(), rhs.oend());
+    }
+
+    // gap mode keeps up to 'limit' elements inserted around one position in a buffer
+    // and moves them into the tree at once, so that inserting and erasing there is O(1).
+    // the buffer is flushed when an element is inserted elsewhere or an operation other
+    // than insert, erase and element access needs the tree. 0 disables it.
+    void set_gap_limit(size_type limit) {
+        flush();
+        gaplimit = limit;
+        gapbuf.reserve(limit);
+    }
+    size_type gap_limit() const {
+        return gaplimit;
+    }
+    // moves the buffered elements into the tree.
+    // const member functions read through the gap and never call this.
+    void flush() {
+        if (gapbuf.empty())
+            return;
+        map_type piece(map.get_allocator());
+#ifndef BOOST_NO_RVALUE_REFERENCES
+        if (boost::is_nothrow_move_constructible<T>::value)
+            piece.assign_sequence(std::make_move_iterator(gapbuf.begin()), gapbuf.size());
+        else
+#endif
+            piece.assign_sequence(gapbuf.begin(), gapbuf.size());
+        paste(gapindex, piece);
+        gapbuf.clear();
     }
 
 private:
-    
-    template <class InputIt>
-    iterator insert_impl(const_iterator pos, InputIt first, InputIt last, std::random_access_iterator_tag const&) {
-        assert(pos.map == this && pos.index <= size());
+    typedef typename detail::deque_augment<T, Weight>::type augment_type;
+    typedef slidable_map<size_type, difference_type, value_type, Allocator, augment_type,
+                         root_search, unthreaded, inline_values, KeyStorage> map_type;
+    typedef typename map_type::node node;
+
+    // makes the gap ready to take an element at index. false if gap mode is off.
+    bool into_gap(size_type index) {
+        if (!gaplimit)
+            return false;
+        if (gapbuf.empty() || index < gapindex || gapindex + gapbuf.size() < index || gapbuf.size() == gaplimit) {
+            flush();
+            gapindex = index;
+        }
+        return true;
+    }
+
+    // the sum of weights of [0, index) of the tree
+    weight_type map_prefix_weight(size_type index) const {
+        weight_type sum = weight_type();
+        node* p = map.root;
+        difference_type rlkey = index;
+        while (p) {
+            map_type::push(p);
+            if (p->key < rlkey) {
+                if (p->left)
+                    sum = sum + p->left->aug.sum;
+                sum = sum + Weight()(p->value());
+                rlkey -= p->key;
+                p = p->right;
+            } else {
+                rlkey -= p->key;
+                p = p->left;
+            }
+        }
+        return sum;
+    }
+    // the sum of weights of the first n elements of the gap
+    weight_type gap_weight(size_type n) const {
+        weight_type sum = weight_type();
+        for (size_type i = 0; i < n; ++i)
+            sum = sum + Weight()(gapbuf[i]);
+        return sum;
+    }
+
+    // the elements of the gap are weighed one by one, and the tree is searched for the rest
+    template <class Compare>
+    size_type index_by_weight(weight_type x, Compare comp) const {
+        if (gapbuf.empty())
+            return map_index_by_weight(x, comp);
+        const weight_type before = map_prefix_weight(gapindex);
+        if (comp(x, before))
+            return map_index_by_weight(x, comp);
+        weight_type y = x - before;
+        for (size_type i = 0; i < gapbuf.size(); ++i) {
+            const weight_type w = Weight()(gapbuf[i]);
+            if (comp(y, w))
+                return gapindex + i;
+            y = y - w;
+        }
+        return map_index_by_weight(x - gap_weight(gapbuf.size()), comp) + gapbuf.size();
+    }
+    template <class Compare>
+    size_type map_index_by_weight(weight_type x, Compare comp) const {
+        node* p = map.root;
+        difference_type key = 0;
+        while (p) {
+            map_type::push(p);
+            key += p->key;
+            if (p->left) {
+                if (comp(x, p->left->aug.sum)) {
+                    p = p->left;
+                    continue;
+                }
+                x = x - p->left->aug.sum;
+            }
+            const weight_type w = Weight()(p->value());
+            if (comp(x, w))
+                return key;
+            x = x - w;
+            p = p->right;
+        }
+        return map.size();
+    }
+
+    // fn may write to the elements, so the weights of the visited ones are summed up again
+    template <class Fn>
+    size_type walk(size_type first, size_type last, Fn& fn) {
         if (first == last)
-            return iterator(this, pos.index);
-        
-        typename map_type::iterator bgn, ins;
-        difference_type qty = std::distance(first, last);
-        map.slide_rightkeys(pos.index, qty);
+            return last;
+        flush();
+        typename map_type::iterator it = map.find(first);
+        size_type i = first;
         try {
-            boost::tie(bgn, boost::tuples::ignore) = map.insert(std::make_pair(pos.index, *first));
-            ins = bgn;
-            while (++first != last) {
-                boost::tie(ins, boost::tuples::ignore) = map.insert_by(ins, +1, *first);
-            } 
+            for (; i != last; ++i, ++it) {
+                T* p = &it->second();
+                if (!fn(boost::make_iterator_range(p, p + 1)))
+                    break;
+            }
+        } catch (...) {
+            map.updatekeys(first, i + 1);
+            throw;
+        }
+        map.updatekeys(first, i == last ? last : i + 1);
+        return i;
+    }
+    template <class Fn>
+    size_type walk(size_type first, size_type last, Fn& fn) const {
+        for (gap_reader it(*this, first); first != last; ++first, ++it) {
+            const T* p = &*it;
+            if (!fn(boost::make_iterator_range(p, p + 1)))
+                return first;
+        }
+        return last;
+    }
+
+    // reads the elements in order without flushing the gap
+    class gap_reader : public boost::iterator_facade<gap_reader, const T, boost::forward_traversal_tag> {
+        friend class boost::iterator_core_access;
+    public:
+        gap_reader(const anywhere_deque& d, size_type n) : deq(&d), index(n), it(d.map.find(d.map_index(n))) {}
+    private:
+        bool in_gap() const {
+            return deq->gapindex <= index && index - deq->gapindex < deq->gapbuf.size();
+        }
+        const T& dereference() const {
+            if (in_gap())
+                return deq->gapbuf[index - deq->gapindex];
+            typename map_type::const_iterator i = it;
+            return i->second();
+        }
+        void increment() {
+            if (!in_gap())
+                ++it;
+            ++index;
+        }
+        bool equal(const gap_reader& rhs) const {
+            return index == rhs.index;
+        }
+
+        const anywhere_deque* deq;
+        size_type index;
+        typename map_type::const_iterator it;
+    };
+    gap_reader obegin() const {
+        return gap_reader(*this, 0);
+    }
+    gap_reader oend() const {
+        return gap_reader(*this, size());
+    }
+    // the index in the tree of the element at index, or of the one after the gap if it is in the gap
+    size_type map_index(size_type index) const {
+        if (gapbuf.empty() || index <= gapindex)
+            return index;
+        if (index - gapindex <= gapbuf.size())
+            return gapindex;
+        return index - gapbuf.size();
+    }
+
+    template <class Integer>
+    void assign_dispatch(Integer count, Integer val, boost::true_type) {
+        assign(static_cast<size_type>(count), static_cast<value_type>(val));
+    }
+    template <class InputIt>
+    void assign_dispatch(InputIt first, InputIt last, boost::false_type) {
+        assign_impl(first, last, typename std::iterator_traits<InputIt>::iterator_category());
+    }
+    template <class InputIt>
+    void assign_impl(InputIt first, InputIt last, std::forward_iterator_tag const&) {
+        const size_type n = std::distance(first, last);
+        gapbuf.clear();
+        map.assign_sequence(first, n);
+    }
+    template <class InputIt>
+    void assign_impl(InputIt first, InputIt last, std::input_iterator_tag const&) {
+        anywhere_deque tmp(get_allocator());
+        for (; first != last; ++first)
+            tmp.push_back(*first);
+        swap(tmp);
+    }
+
+    // moves [first,last) to empty 'piece' whose keys start with 0
+    void cut(size_type first, size_type last, map_type& piece) {
+        assert(piece.empty() && first <= last && last <= map.size());
+        const size_type n = map.size();
+        map_type tail(map.get_allocator());
+        map.split_at(first, piece, n - first);
+        piece.slide_all(-difference_type(first));
+        piece.split_at(last - first, tail, n - last);
+        tail.slide_all(difference_type(first) - difference_type(last - first));
+        map.concat(tail);
+    }
+
+    template <class Compare>
+    void sort_impl(Compare comp, bool stable) {
+        flush();
+        if (size() < 2)
+            return;
+        std::vector<T, Allocator> buf(get_allocator());
+        buf.reserve(size());
+        typename map_type::iterator it = map.begin(), e = map.end();
+        for (; it != e; ++it)
+            buf.push_back(boost::move(it->second()));
+        try {
+            detail::parallel_sort(buf.begin(), buf.end(), comp, stable);
         } catch (...) {
-            map.erase(bgn, ins);
-            if(ins != map.end())
-                map.erase(ins);
-            map.slide_rightkeys(pos.index, -qty);
+            put_back(buf);
             throw;
         }
+        put_back(buf);
+    }
+    void put_back(std::vector<T, Allocator>& buf) {
+        typename map_type::iterator it = map.begin(), e = map.end();
+        for (std::size_t i = 0; it != e; ++it, ++i)
+            it->second() = boost::move(buf[i]);
+        map_type::updatesubtree(map.root);
+    }
+
+    // moves the first n elements of 'from' whose keys start with 0 to the back of 'to'
+    static void move_front(map_type& from, size_type n, map_type& to) {
+        if (!n)
+            return;
+        map_type tail(from.get_allocator());
+        from.split_at(n, tail, from.size() - n);
+        tail.slide_all(-difference_type(n));
+        from.slide_all(difference_type(to.size()));
+        to.concat(from);
+        from.swap(tail);
+    }
+
+    // throws std::overflow_error if n elements can not be added to size elements.
+    // the keys of the tree are indices, so they would not fit its key storage.
+    void checkgrowth(size_type size, size_type n) const {
+        if (max_size() - size < n)
+            throw std::overflow_error("anywhere_deque: max_size() exceeded");
+    }
+
+    // moves all of 'piece' whose keys start with 0 to index
+    void paste(size_type index, map_type& piece) {
+        assert(index <= map.size());
+        const size_type k = piece.size();
+        checkgrowth(map.size(), k);
+        map_type tail(map.get_allocator());
+        map.split_at(index, tail, map.size() - index);
+        piece.slide_all(difference_type(index));
+        map.concat(piece);
+        tail.slide_all(difference_type(k));
+        map.concat(tail);
+    }
+
+    template <class InputIt>
+    iterator insert_impl(const_iterator pos, InputIt first, InputIt last, std::forward_iterator_tag const&) {
+        assert(pos.map == this && pos.index <= size());
+        flush();
+        map_type piece(map.get_allocator());
+        piece.assign_sequence(first, std::distance(first, last));
+        paste(pos.index, piece);
         return iterator(this, pos.index);
     }
     
     template <class InputIt>
-    iterator insert_impl(const_iterator pos, InputIt first, InputIt last, std::forward_iterator_tag const&) {
+    iterator insert_impl(const_iterator pos, InputIt first, InputIt last, std::input_iterator_tag const&) {
         assert(pos.map == this && pos.index <= size());
         size_type r = pos.index;
         try {
@@ -393,16 +1193,68 @@ private:
         return iterator(this, r);
     }
     
-    typedef slidable_map<size_type, difference_type, value_type, Allocator> map_type;
     map_type map;
+    std::vector<T, Allocator> gapbuf;
+    size_type gapindex;
+    size_type gaplimit;
 };
 
+// versions of std algorithms which step from node to node in amortized O(1) instead of looking up
+// every element from the root. a node of anywhere_deque holds one element, so the elements are
+// still visited one by one and never copied as contiguous spans.
+// the ones which only read walk the container as const, so they neither flush the gap nor reweigh.
+template <class Map, class V, class R, class OutputIt>
+OutputIt copy(detail::iterator_base<Map,V,R> first, detail::iterator_base<Map,V,R> last, OutputIt out) {
+    typedef detail::segment_access access;
+    detail::segment_copy<OutputIt> f(out);
+    access::walk(static_cast<const Map&>(access::container(first)), access::index(first), access::index(last), f);
+    return f.out;
+}
+
+template <class Map, class V, class R, class U>
+void fill(detail::iterator_base<Map,V,R> first, detail::iterator_base<Map,V,R> last, const U& val) {
+    typedef detail::segment_access access;
+    detail::segment_fill<U> f(val);
+    access::walk(access::container(first), access::index(first), access::index(last), f);
+}
+
+template <class Map, class V, class R, class U>
+detail::iterator_base<Map,V,R> find(detail::iterator_base<Map,V,R> first, detail::iterator_base<Map,V,R> last, const U& val) {
+    typedef detail::segment_access access;
+    detail::segment_find<U> f(val);
+    std::size_t n = access::walk(static_cast<const Map&>(access::container(first)), access::index(first), access::index(last), f);
+    if (n == access::index(last))
+        return last;
+    return first + ((n + f.offset) - access::index(first));
+}
+
+template <class Map, class V, class R, class U, class BinaryOp>
+U accumulate(detail::iterator_base<Map,V,R> first, detail::iterator_base<Map,V,R> last, U init, BinaryOp op) {
+    typedef detail::segment_access access;
+    detail::segment_accumulate<U, BinaryOp> f(init, op);
+    access::walk(static_cast<const Map&>(access::container(first)), access::index(first), access::index(last), f);
+    return f.sum;
+}
+
+template <class Map, class V, class R, class U>
+U accumulate(detail::iterator_base<Map,V,R> first, detail::iterator_base<Map,V,R> last, U init) {
+    return gununu::accumulate(first, last, init, std::plus<U>());
+}
+
+template <class Map, class V, class R, class Fn>
+Fn for_each(detail::iterator_base<Map,V,R> first, detail::iterator_base<Map,V,R> last, Fn fn) {
+    typedef detail::segment_access access;
+    detail::element_for_each<Fn> f(fn);
+    access::walk(access::container(first), access::index(first), access::index(last), f);
+    return fn;
+}
+
 } //namespace gununu
 
 namespace std {
 
-template <class T, class A>
-void swap(gununu::anywhere_deque<T,A>& lhs, gununu::anywhere_deque<T,A>& rhs) {
+template <class T, class A, class W, class K>
+void swap(gununu::anywhere_deque<T,A,W,K>& lhs, gununu::anywhere_deque<T,A,W,K>& rhs) {
     lhs.swap(rhs);
 }
 
@@ -0,0 +1,636 @@
+#ifndef ANYWHERE_STRING_HPP
+#define ANYWHERE_STRING_HPP
+
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "anywhere_deque.hpp"
+
+namespace gununu {
+
+namespace detail {
+
+// the number of bytes and newlines in a piece of text
+struct text_weight {
+    text_weight() : bytes(0), lines(0) {}
+    text_weight(std::size_t b, std::size_t l) : bytes(b), lines(l) {}
+    std::size_t bytes;
+    std::size_t lines;
+};
+inline text_weight operator + (const text_weight& lhs, const text_weight& rhs) {
+    return text_weight(lhs.bytes + rhs.bytes, lhs.lines + rhs.lines);
+}
+inline text_weight operator - (const text_weight& lhs, const text_weight& rhs) {
+    return text_weight(lhs.bytes - rhs.bytes, lhs.lines - rhs.lines);
+}
+inline bool operator < (const text_weight& lhs, const text_weight& rhs) {
+    return lhs.bytes < rhs.bytes;
+}
+struct line_less {
+    bool operator () (const text_weight& lhs, const text_weight& rhs) const {
+        return lhs.lines < rhs.lines;
+    }
+};
+
+// the inner loop counts into a byte so that compilers can vectorize it
+inline std::size_t count_char(const char* p, std::size_t n, char c) {
+    std::size_t r = 0;
+    while (n) {
+        const std::size_t m = (std::min)(n, std::size_t(255));
+        unsigned char k = 0;
+        for (std::size_t i = 0; i < m; ++i)
+            k += (p[i] == c);
+        r += k;
+        p += m;
+        n -= m;
+    }
+    return r;
+}
+
+// the offset of the k-th (0-based) c in [p, p+n). n if there are not enough.
+inline std::size_t find_nth_char(const char* p, std::size_t n, char c, std::size_t k) {
+    const char* q = p;
+    const char* const end = p + n;
+    for (;;) {
+        q = static_cast<const char*>(std::memchr(q, c, end - q));
+        if (!q)
+            return n;
+        if (!k--)
+            return q - p;
+        ++q;
+    }
+}
+
+template <class Allocator>
+struct text_chunk {
+    typedef std::basic_string<char, std::char_traits<char>, Allocator> string_type;
+    explicit text_chunk(const Allocator& a) : text(a), lines(0) {}
+
+    string_type text;
+    std::size_t lines;
+};
+
+struct text_measure {
+    typedef text_weight result_type;
+    template <class Chunk>
+    text_weight operator () (const Chunk& c) const {
+        return text_weight(c.text.size(), c.lines);
+    }
+};
+
+// cuts the bytes of [first, last) of a text into segments of chunks
+template <class Fn>
+class text_walker {
+public:
+    text_walker(Fn& f, std::size_t first, std::size_t last, std::size_t offset)
+        : fn(f), pos(first), end(last), off(offset) {}
+    template <class Chunk>
+    bool operator () (const boost::iterator_range<Chunk*>& r) {
+        const Chunk& c = *r.begin();
+        const std::size_t n = (std::min)(c.text.size() - off, end - pos);
+        const char* p = c.text.data() + off;
+        off = 0;
+        if (!fn(boost::make_iterator_range(p, p + n)))
+            return false;
+        pos += n;
+        return pos != end;
+    }
+    Fn& fn;
+    std::size_t pos;
+    std::size_t end;
+    std::size_t off;
+};
+
+template <class Range>
+inline std::size_t segment_search_in(const Range& r, const char* s, std::size_t n) {
+    const char* const first = r.begin();
+    const char* const last = r.end();
+    for (const char* q = first; last - q >= static_cast<std::ptrdiff_t>(n); ++q) {
+        q = static_cast<const char*>(std::memchr(q, s[0], (last - q) - n + 1));
+        if (!q)
+            break;
+        if (std::memcmp(q, s, n) == 0)
+            return q - first;
+    }
+    return last - first;
+}
+
+// finds a string which may straddle segments.
+// the last n-1 bytes seen are kept to find the matches that start in earlier segments.
+class segment_search {
+public:
+    segment_search(const char* str, std::size_t len)
+        : s(str), n(len), pos(0), found(std::size_t(-1)) {}
+    template <class Range>
+    bool operator () (const Range& r) {
+        const std::size_t len = r.end() - r.begin();
+        if (!carry.empty()) {
+            std::string tmp(carry);
+            tmp.append(r.begin(), (std::min)(len, n - 1));
+            const std::size_t i = std::search(tmp.begin(), tmp.end(), s, s + n) - tmp.begin();
+            if (i < carry.size()) {
+                found = pos - carry.size() + i;
+                return false;
+            }
+        }
+        const std::size_t i = segment_search_in(r, s, n);
+        if (i != len) {
+            found = pos + i;
+            return false;
+        }
+        if (len >= n - 1) {
+            carry.assign(r.end() - (n - 1), r.end());
+        } else {
+            carry.append(r.begin(), r.end());
+            carry.erase(0, carry.size() - (std::min)(carry.size(), n - 1));
+        }
+        pos += len;
+        return true;
+    }
+    const char* s;
+    std::size_t n;
+    std::size_t pos;
+    std::size_t found;
+    std::string carry;
+};
+
+struct segment_find_char {
+    explicit segment_find_char(char ch) : c(ch), offset(0) {}
+    template <class Range>
+    bool operator () (const Range& r) {
+        const std::size_t len = r.end() - r.begin();
+        const void* q = std::memchr(r.begin(), c, len);
+        offset = q ? static_cast<const char*>(q) - r.begin() : len;
+        return !q;
+    }
+    char c;
+    std::size_t offset;
+};
+
+struct segment_count_char {
+    explicit segment_count_char(char ch) : c(ch), num(0) {}
+    template <class Range>
+    bool operator () (const Range& r) {
+        num += count_char(r.begin(), r.end() - r.begin(), c);
+        return true;
+    }
+    char c;
+    std::size_t num;
+};
+
+template <class String>
+struct segment_append {
+    explicit segment_append(String& s) : str(s) {}
+    template <class Range>
+    bool operator () (const Range& r) {
+        str.append(r.begin(), r.end());
+        return true;
+    }
+    String& str;
+};
+}
+
+// a string that can insert and erase anywhere in O(logN + length of the inserted or erased text).
+// the text is held in chunks of up to ChunkSize contiguous bytes, and each subtree keeps
+// the number of bytes and newlines in it.
+template <class Allocator = std::allocator<char>, std::size_t ChunkSize = 4096>
+class anywhere_string : private Allocator {
+    friend class detail::segment_access;
+    typedef detail::text_chunk<Allocator> chunk;
+    typedef typename Allocator::template rebind<chunk>::other chunk_allocator;
+    typedef anywhere_deque<chunk, chunk_allocator, detail::text_measure> chunk_deque;
+    typedef std::vector<chunk, chunk_allocator> chunk_vector;
+public:
+    typedef detail::iterator_base<const anywhere_string, char, const char&> const_iterator;
+    typedef const_iterator iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+    typedef const_reverse_iterator reverse_iterator;
+
+    typedef char value_type;
+    typedef const char& reference;
+    typedef const char& const_reference;
+    typedef Allocator allocator_type;
+    typedef std::size_t size_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef std::basic_string<char, std::char_traits<char>, Allocator> string_type;
+
+    static const size_type npos = size_type(-1);
+    static const size_type chunk_size = ChunkSize;
+
+    explicit anywhere_string(const Allocator& a = Allocator()) : Allocator(a), chunks(chunk_allocator(a)) {}
+    anywhere_string(const char* s, const Allocator& a = Allocator()) : Allocator(a), chunks(chunk_allocator(a)) {
+        assign(s, std::strlen(s));
+    }
+    anywhere_string(const char* s, size_type n, const Allocator& a = Allocator()) : Allocator(a), chunks(chunk_allocator(a)) {
+        assign(s, n);
+    }
+    template <class Traits, class A>
+    anywhere_string(const std::basic_string<char, Traits, A>& s, const Allocator& a = Allocator()) : Allocator(a), chunks(chunk_allocator(a)) {
+        assign(s.data(), s.size());
+    }
+    // reads the text in one pass. suitable for std::istreambuf_iterator.
+    template <class InputIt>
+    anywhere_string(InputIt first, InputIt last, const Allocator& a = Allocator()) : Allocator(a), chunks(chunk_allocator(a)) {
+        assign(first, last);
+    }
+
+    anywhere_string& assign(const char* s, size_type n) {
+        chunk_vector pieces(chunk_alloc());
+        pack(pieces, n).feed(s, n);
+        chunk_deque tmp(chunk_alloc());
+        tmp.assign(std::make_move_iterator(pieces.begin()), std::make_move_iterator(pieces.end()));
+        chunks.swap(tmp);
+        return *this;
+    }
+    anywhere_string& assign(const char* s) {
+        return assign(s, std::strlen(s));
+    }
+    template <class Traits, class A>
+    anywhere_string& assign(const std::basic_string<char, Traits, A>& s) {
+        return assign(s.data(), s.size());
+    }
+    template <class InputIt>
+    anywhere_string& assign(InputIt first, InputIt last) {
+        chunk_vector pieces(chunk_alloc());
+        chunk c(get_allocator());
+        c.text.reserve(chunk_size);
+        for (; first != last; ++first) {
+            c.text.push_back(*first);
+            if (c.text.size() == chunk_size) {
+                c.lines = detail::count_char(c.text.data(), c.text.size(), '\n');
+                pieces.push_back(std::move(c));
+                c = chunk(get_allocator());
+                c.text.reserve(chunk_size);
+            }
+        }
+        if (!c.text.empty()) {
+            c.lines = detail::count_char(c.text.data(), c.text.size(), '\n');
+            pieces.push_back(std::move(c));
+        }
+        chunk_deque tmp(chunk_alloc());
+        tmp.assign(std::make_move_iterator(pieces.begin()), std::make_move_iterator(pieces.end()));
+        chunks.swap(tmp);
+        return *this;
+    }
+
+    anywhere_string& insert(size_type pos, const char* s, size_type n) {
+        if (size() < pos)
+            throw std::out_of_range("anywhere_string::insert");
+        if (!n)
+            return *this;
+        if (chunks.empty())
+            return assign(s, n);
+        size_type off;
+        size_type ci = locate(pos, off);
+        if (!off && ci) {
+            --ci;
+            off = chunks[ci].text.size();
+        }
+        chunk& c = chunks[ci];
+        if (c.text.size() + n <= chunk_size) {
+            c.text.insert(off, s, n);
+            c.lines += detail::count_char(s, n, '\n');
+            chunks.reweigh(chunks.begin() + ci);
+            return *this;
+        }
+        // rebuilds the chunk with the inserted text in chunks of nearly equal size
+        chunk_vector pieces(chunk_alloc());
+        pack(pieces, c.text.size() + n).feed(c.text.data(), off).feed(s, n).feed(c.text.data() + off, c.text.size() - off);
+        chunks.insert(chunks.begin() + (ci + 1), std::make_move_iterator(pieces.begin()), std::make_move_iterator(pieces.end()));
+        chunks.erase(chunks.begin() + ci);
+        mend(ci + pieces.size() - 1, ci + pieces.size());
+        mend(ci ? ci - 1 : 0, ci);
+        return *this;
+    }
+    anywhere_string& insert(size_type pos, const char* s) {
+        return insert(pos, s, std::strlen(s));
+    }
+    template <class Traits, class A>
+    anywhere_string& insert(size_type pos, const std::basic_string<char, Traits, A>& s) {
+        return insert(pos, s.data(), s.size());
+    }
+    anywhere_string& insert(size_type pos, size_type count, char c) {
+        return insert(pos, string_type(count, c, get_allocator()));
+    }
+
+    anywhere_string& append(const char* s, size_type n) {
+        return insert(size(), s, n);
+    }
+    anywhere_string& append(const char* s) {
+        return insert(size(), s);
+    }
+    template <class Traits, class A>
+    anywhere_string& append(const std::basic_string<char, Traits, A>& s) {
+        return insert(size(), s);
+    }
+    void push_back(char c) {
+        insert(size(), &c, 1);
+    }
+    anywhere_string& operator += (const char* s) {
+        return append(s);
+    }
+    template <class Traits, class A>
+    anywhere_string& operator += (const std::basic_string<char, Traits, A>& s) {
+        return append(s);
+    }
+    anywhere_string& operator += (char c) {
+        push_back(c);
+        return *this;
+    }
+
+    anywhere_string& erase(size_type pos = 0, size_type n = npos) {
+        if (size() < pos)
+            throw std::out_of_range("anywhere_string::erase");
+        n = (std::min)(n, size() - pos);
+        if (!n)
+            return *this;
+        size_type offa, offb;
+        const size_type a = locate(pos, offa);
+        const size_type b = locate(pos + n - 1, offb);
+        if (a == b) {
+            chunk& c = chunks[a];
+            c.lines -= detail::count_char(c.text.data() + offa, n, '\n');
+            c.text.erase(offa, n);
+            chunks.reweigh(chunks.begin() + a);
+        } else {
+            chunk& cb = chunks[b];
+            cb.lines -= detail::count_char(cb.text.data(), offb + 1, '\n');
+            cb.text.erase(0, offb + 1);
+            chunks.reweigh(chunks.begin() + b);
+            chunk& ca = chunks[a];
+            ca.lines -= detail::count_char(ca.text.data() + offa, ca.text.size() - offa, '\n');
+            ca.text.erase(offa);
+            chunks.reweigh(chunks.begin() + a);
+            chunks.erase(chunks.begin() + (a + 1), chunks.begin() + b);
+            if (chunks[a + 1].text.empty())
+                chunks.erase(chunks.begin() + (a + 1));
+        }
+        if (chunks[a].text.empty())
+            chunks.erase(chunks.begin() + a);
+        mend(a ? a - 1 : 0, a + 2);
+        return *this;
+    }
+
+    anywhere_string& replace(size_type pos, size_type n, const char* s, size_type m) {
+        erase(pos, n);
+        return insert(pos, s, m);
+    }
+    template <class Traits, class A>
+    anywhere_string& replace(size_type pos, size_type n, const std::basic_string<char, Traits, A>& s) {
+        return replace(pos, n, s.data(), s.size());
+    }
+
+    void clear() {
+        chunks.clear();
+    }
+    void swap(anywhere_string& other) {
+        chunks.swap(other.chunks);
+    }
+
+    size_type size() const {
+        return chunks.total_weight().bytes;
+    }
+    size_type length() const {
+        return size();
+    }
+    bool empty() const {
+        return chunks.empty();
+    }
+    allocator_type get_allocator() const {
+        return *this;
+    }
+
+    const_reference operator [] (size_type index) const {
+        assert(index < size());
+        size_type off;
+        const size_type ci = locate(index, off);
+        return chunks[ci].text[off];
+    }
+    const_reference at(size_type index) const {
+        if (size() <= index)
+            throw std::out_of_range("anywhere_string::at");
+        return (*this)[index];
+    }
+    const_reference front() const {
+        assert(!empty());
+        return chunks.front().text[0];
+    }
+    const_reference back() const {
+        assert(!empty());
+        const chunk& c = chunks.back();
+        return c.text[c.text.size() - 1];
+    }
+
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, size()); }
+    const_iterator cbegin() const { return begin(); }
+    const_iterator cend() const { return end(); }
+    const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+    const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+    const_reverse_iterator crbegin() const { return rbegin(); }
+    const_reverse_iterator crend() const { return rend(); }
+
+    string_type substr(size_type pos = 0, size_type n = npos) const {
+        if (size() < pos)
+            throw std::out_of_range("anywhere_string::substr");
+        n = (std::min)(n, size() - pos);
+        string_type ret(get_allocator());
+        ret.reserve(n);
+        detail::segment_append<string_type> f(ret);
+        walk(pos, pos + n, f);
+        return ret;
+    }
+    string_type str() const {
+        return substr();
+    }
+
+    // the chunks are searched by memchr and memcmp, which are vectorized by the C library.
+    size_type find(char c, size_type pos = 0) const {
+        if (size() <= pos)
+            return npos;
+        detail::segment_find_char f(c);
+        const size_type n = walk(pos, size(), f);
+        return (n == size()) ? npos : n + f.offset;
+    }
+    size_type find(const char* s, size_type pos, size_type n) const {
+        if (size() < pos || size() - pos < n)
+            return npos;
+        if (!n)
+            return pos;
+        if (n == 1)
+            return find(s[0], pos);
+        detail::segment_search f(s, n);
+        walk(pos, size(), f);
+        return (f.found == npos) ? npos : pos + f.found;
+    }
+    size_type find(const char* s, size_type pos = 0) const {
+        return find(s, pos, std::strlen(s));
+    }
+    template <class Traits, class A>
+    size_type find(const std::basic_string<char, Traits, A>& s, size_type pos = 0) const {
+        return find(s.data(), pos, s.size());
+    }
+
+    // the number of c in [pos, pos+n). newlines are counted in O(logN).
+    size_type count(char c, size_type pos = 0, size_type n = npos) const {
+        if (size() < pos)
+            throw std::out_of_range("anywhere_string::count");
+        n = (std::min)(n, size() - pos);
+        if (c == '\n')
+            return line_of(pos + n) - line_of(pos);
+        detail::segment_count_char f(c);
+        walk(pos, pos + n, f);
+        return f.num;
+    }
+
+    // lines and columns are 0-based. a line ends with '\n', and the last line may be empty.
+    size_type line_count() const {
+        return chunks.total_weight().lines + 1;
+    }
+    // the line that contains pos
+    size_type line_of(size_type pos) const {
+        assert(pos <= size());
+        if (!pos)
+            return 0;
+        size_type off;
+        const size_type ci = locate(pos, off);
+        return chunks.prefix_weight(ci).lines + detail::count_char(chunks[ci].text.data(), off, '\n');
+    }
+    // the position of the first byte of the line. npos if line is not less than line_count().
+    size_type line_begin(size_type line) const {
+        if (!line)
+            return 0;
+        if (line_count() <= line)
+            return npos;
+        const detail::text_weight x(0, line - 1);
+        const size_type ci = chunks.find_by_weight(x, detail::line_less()) - chunks.begin();
+        const detail::text_weight w = chunks.prefix_weight(ci);
+        const chunk& c = chunks[ci];
+        return w.bytes + detail::find_nth_char(c.text.data(), c.text.size(), '\n', x.lines - w.lines) + 1;
+    }
+    size_type column_of(size_type pos) const {
+        return pos - line_begin(line_of(pos));
+    }
+
+    // calls fn(boost::iterator_range<const char*>) for each contiguous piece of [first,last)
+    template <class Fn>
+    Fn for_each_segment(const_iterator first, const_iterator last, Fn fn) const {
+        assert(first.map == this && last.map == this && first.index <= last.index && last.index <= size());
+        detail::segment_for_each<Fn> f(fn);
+        walk(first.index, last.index, f);
+        return fn;
+    }
+
+private:
+    // fills 'out' with chunks of nearly equal size from the bytes given to feed() in order
+    class packer {
+    public:
+        packer(chunk_vector& o, size_type total, const Allocator& a) : out(o), alloc(a), cur(a), rest(total) {
+            const size_type k = (total + chunk_size - 1) / chunk_size;
+            pieces = k;
+            start();
+        }
+        packer& feed(const char* s, size_type n) {
+            while (n) {
+                const size_type m = (std::min)(n, target - cur.text.size());
+                cur.text.append(s, m);
+                s += m;
+                n -= m;
+                if (cur.text.size() == target) {
+                    cur.lines = detail::count_char(cur.text.data(), cur.text.size(), '\n');
+                    out.push_back(std::move(cur));
+                    rest -= target;
+                    --pieces;
+                    cur = chunk(alloc);
+                    start();
+                }
+            }
+            return *this;
+        }
+    private:
+        void start() {
+            target = pieces ? (rest + pieces - 1) / pieces : 0;
+            cur.text.reserve(target);
+        }
+        chunk_vector& out;
+        Allocator alloc;
+        chunk cur;
+        size_type rest;
+        size_type pieces;
+        size_type target;
+    };
+    packer pack(chunk_vector& out, size_type total) const {
+        out.reserve((total + chunk_size - 1) / chunk_size);
+        return packer(out, total, get_allocator());
+    }
+
+    // the chunk that contains pos and the offset in it. pos == size() gives the end of the last chunk.
+    size_type locate(size_type pos, size_type& off) const {
+        assert(pos <= size() && !chunks.empty());
+        if (pos == size()) {
+            off = chunks.back().text.size();
+            return chunks.size() - 1;
+        }
+        const size_type ci = chunks.find_by_weight(detail::text_weight(pos, 0)) - chunks.begin();
+        off = pos - chunks.prefix_weight(ci).bytes;
+        return ci;
+    }
+
+    chunk_allocator chunk_alloc() const {
+        return chunk_allocator(get_allocator());
+    }
+
+    // merges the pairs of adjacent chunks in [first, last) that fit in one chunk,
+    // so that every two adjacent chunks hold more than chunk_size bytes.
+    void mend(size_type first, size_type last) {
+        while (first < last && first + 1 < chunks.size()) {
+            chunk& l = chunks[first];
+            const chunk& r = chunks[first + 1];
+            if (chunk_size < l.text.size() + r.text.size()) {
+                ++first;
+                continue;
+            }
+            try {
+                l.text.append(r.text);
+            } catch (...) {
+                return; // merging is only for the memory usage
+            }
+            l.lines += r.lines;
+            chunks.reweigh(chunks.begin() + first);
+            chunks.erase(chunks.begin() + (first + 1));
+            --last;
+        }
+    }
+
+    template <class Fn>
+    size_type walk(size_type first, size_type last, Fn& fn) const {
+        if (first == last)
+            return last;
+        size_type off;
+        const size_type ci = locate(first, off);
+        detail::text_walker<Fn> w(fn, first, last, off);
+        detail::segment_access::walk(chunks, ci, chunks.size(), w);
+        return w.pos;
+    }
+
+    chunk_deque chunks;
+};
+
+template <class A, std::size_t N>
+const typename anywhere_string<A,N>::size_type anywhere_string<A,N>::npos;
+template <class A, std::size_t N>
+const typename anywhere_string<A,N>::size_type anywhere_string<A,N>::chunk_size;
+
+} //namespace gununu
+
+namespace std {
+
+template <class A, std::size_t N>
+void swap(gununu::anywhere_string<A,N>& lhs, gununu::anywhere_string<A,N>& rhs) {
+    lhs.swap(rhs);
+}
+
+} //namespace std
+
+#endif
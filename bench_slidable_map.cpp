@@ -0,0 +1,77 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <boost/random.hpp>
+#include "slidable_map.hpp"
+using namespace std;
+using namespace gununu;
+
+// compares the balancing and search policies of slidable_map.
+// build with optimization, e.g. g++ -std=c++14 -O2 -I. bench_slidable_map.cpp
+
+typedef std::allocator<std::pair<const int, int> > bench_alloc;
+
+template <class F>
+double bench_ms(F f) {
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// the values found are added here so that the searches are not optimized away
+volatile int bench_sink = 0;
+
+template <class Map>
+void bench_map(const char* name, int n) {
+    boost::random::mt19937 mt(1);
+    boost::random::uniform_int_distribution<> key(0, n * 4);
+    std::vector<int> keys(n);
+    for (int i=0; i<n; ++i)
+        keys[i] = key(mt);
+
+    Map m;
+    const double insert = bench_ms([&] {
+        for (int i=0; i<n; ++i)
+            m.insert(std::make_pair(keys[i], i));
+    });
+    const double lookup = bench_ms([&] {
+        for (int r=0; r<4; ++r)
+            for (int i=0; i<n; ++i) {
+                typename Map::iterator p = m.find(keys[i]);
+                bench_sink += p->second();
+            }
+    });
+    // scrubbing: searches around a cursor which moves back and forth a little, with an edit now and then
+    boost::random::uniform_int_distribution<> step(-64, 64);
+    const double scrub = bench_ms([&] {
+        int cursor = n * 2;
+        for (int i=0; i<n * 4; ++i) {
+            cursor = std::min(std::max(cursor + step(mt), 0), n * 4);
+            typename Map::iterator p = m.lower_bound(cursor);
+            if (p != m.end())
+                bench_sink += p->second();
+            if (i % 64 == 0)
+                m.slide_rightkeys(cursor, 1);
+        }
+    });
+    const double erase = bench_ms([&] {
+        for (int i=0; i<n; i+=2)
+            m.erase(m.lower_bound(keys[i]));
+    });
+    cout << setw(26) << left << name << right << fixed << setprecision(1)
+         << setw(10) << insert << setw(10) << lookup << setw(10) << scrub << setw(10) << erase << "\n";
+}
+
+int main()
+{
+    const int n = 1000000;
+    cout << "elements: " << n << " (ms)\n";
+    cout << setw(26) << left << "policy" << right << setw(10) << "insert" << setw(10) << "lookup"
+         << setw(10) << "scrub" << setw(10) << "erase" << "\n";
+    bench_map<slidable_map<int, int, int> >("red_black, root_search", n);
+    bench_map<slidable_map<int, int, int, bench_alloc, detail::no_augment, root_search, unthreaded, inline_values, wide_keys, avl_balance> >("avl, root_search", n);
+    bench_map<slidable_map<int, int, int, bench_alloc, detail::no_augment, finger_search> >("red_black, finger_search", n);
+    bench_map<slidable_map<int, int, int, bench_alloc, detail::no_augment, finger_search, unthreaded, inline_values, wide_keys, avl_balance> >("avl, finger_search", n);
+    return 0;
+}
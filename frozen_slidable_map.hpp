@@ -0,0 +1,217 @@
+#ifndef FROZEN_SLIDABLE_MAP_HPP
+#define FROZEN_SLIDABLE_MAP_HPP
+
+#include <iterator>
+#include <vector>
+#include "slidable_map.hpp"
+
+namespace gununu {
+
+// immutable map made by slidable_map::freeze() for maps that are built once and searched many times.
+// the keys are stored absolute in eytzinger order (the children of slot k are 2k and 2k+1), so that
+// a search touches one array from the top and the next levels can be prefetched. the values are kept
+// in a separate array in the same order. slide_all() only changes the offset which is added to every key.
+template <class Key, class Diff, class Type, class Alloc = std::allocator<std::pair<const Key, Type> > >
+class frozen_slidable_map : Alloc
+{
+public:
+typedef Key key_type;
+typedef Type mapped_type;
+typedef std::pair<const Key, Type> value_type;
+typedef Alloc allocator_type;
+typedef typename Alloc::size_type size_type;
+typedef slidable_map<Key, Diff, Type, Alloc> thawed_type;
+
+private:
+typedef typename Alloc::template rebind<Diff>::other KeyAllocator;
+typedef typename Alloc::template rebind<Type>::other ValueAllocator;
+typedef typename Alloc::template rebind<const Type*>::other PointerAllocator;
+
+public:
+class const_iterator : public std::iterator<std::bidirectional_iterator_tag, value_type>
+{
+    friend class frozen_slidable_map;
+    const_iterator(const frozen_slidable_map* c, size_type k) : container(c), slot(k) {}
+public:
+    const_iterator() : container(NULL), slot(0) {}
+
+    Key first() const {
+        Key ret = Key();
+        ret += container->keys[slot - 1] + container->offset;
+        return ret;
+    }
+    const Type& second() const { return container->values[slot - 1]; }
+    const const_iterator& operator * () const { return *this; }
+    const const_iterator* operator -> () const { return this; }
+
+    const_iterator& operator ++ ()
+    {
+        slot = container->nextslot(slot);
+        return *this;
+    }
+    const_iterator& operator -- ()
+    {
+        slot = container->prevslot(slot);
+        return *this;
+    }
+    const_iterator operator ++ (int)
+    {
+        const_iterator tmp = *this;
+        ++*this;
+        return tmp;
+    }
+    const_iterator operator -- (int)
+    {
+        const_iterator tmp = *this;
+        --*this;
+        return tmp;
+    }
+    friend bool operator == (const const_iterator& lhs, const const_iterator& rhs)
+    {
+        assert(lhs.container == rhs.container);
+        return lhs.slot == rhs.slot;
+    }
+    friend bool operator != (const const_iterator& lhs, const const_iterator& rhs)
+    {
+        return !(lhs == rhs);
+    }
+private:
+    const frozen_slidable_map* container;
+    size_type slot;
+};
+typedef const_iterator iterator;
+
+    explicit frozen_slidable_map(const Alloc& a = Alloc())
+        : Alloc(a), offset(), keys((KeyAllocator(a))), values((ValueAllocator(a))) {}
+
+    // copies the elements of m. slidable_map::freeze() calls this.
+    template <class G, class S, class H, class L, class W, class B>
+    explicit frozen_slidable_map(const slidable_map<Key, Diff, Type, Alloc, G, S, H, L, W, B>& m)
+        : Alloc(m.get_allocator()), offset(), keys((KeyAllocator(m.get_allocator()))), values((ValueAllocator(m.get_allocator())))
+    {
+        const size_type n = m.size();
+        std::vector<const Type*, PointerAllocator> order(n, NULL, PointerAllocator(m.get_allocator()));
+        keys.resize(n);
+        typename slidable_map<Key, Diff, Type, Alloc, G, S, H, L, W, B>::const_iterator it = m.begin();
+        for (size_type k = firstslot(); k; k = nextslot(k), ++it) {
+            keys[k - 1] = it->first() - Key();
+            order[k - 1] = &it->second();
+        }
+        values.reserve(n);
+        for (size_type i=0; i<n; ++i)
+            values.push_back(*order[i]);
+    }
+
+    void swap(frozen_slidable_map& rhs)
+    {
+        std::swap(offset, rhs.offset);
+        keys.swap(rhs.keys);
+        values.swap(rhs.values);
+    }
+
+    Alloc       get_allocator() const { return static_cast<const Alloc&>(*this); }
+    size_type   size() const { return keys.size(); }
+    bool        empty() const { return keys.empty(); }
+
+    const_iterator   begin() const { return const_iterator(this, firstslot()); }
+    const_iterator  cbegin() const { return begin(); }
+    const_iterator     end() const { return const_iterator(this, 0); }
+    const_iterator    cend() const { return end(); }
+
+    const_iterator find(const Key& key) const
+    {
+        const Diff rlkey = key - Key() - offset;
+        const size_type k = searchslot(rlkey, false);
+        return (k && !(rlkey < keys[k - 1])) ? const_iterator(this, k) : end();
+    }
+    size_type count(const Key& key) const { return (find(key) != end()) ? 1 : 0; }
+    const_iterator lower_bound(const Key& key) const { return const_iterator(this, searchslot(key - Key() - offset, false)); }
+    const_iterator upper_bound(const Key& key) const { return const_iterator(this, searchslot(key - Key() - offset, true)); }
+
+    // moves every key by qty.
+    void slide_all(const Diff& qty) { offset += qty; }
+
+    // copies the elements back into a slidable_map, which is built balanced in O(N).
+    thawed_type thaw() const
+    {
+        thawed_type ret(get_allocator());
+        ret.assign_sorted(begin(), size());
+        return ret;
+    }
+
+private:
+    // the slot of the first key not less than rlkey (greater than rlkey if upper), or 0.
+    // the loop has no branch on the comparison; k collects the turns, and the answer is the
+    // last node where the search went left, which is k with the trailing right turns removed.
+    size_type searchslot(const Diff& rlkey, bool upper) const
+    {
+        const size_type n = keys.size();
+        const Diff* base = n ? &keys[0] : NULL;
+        size_type k = 1;
+        while (k <= n) {
+            // the 16 descendants 4 levels below are next to each other
+            if ((k << 4) <= n)
+                detail::prefetch(base + (k << 4) - 1);
+            const bool right = upper ? !(rlkey < base[k - 1]) : (base[k - 1] < rlkey);
+            k = 2 * k + right;
+        }
+        while (k & 1)
+            k >>= 1;
+        return k >> 1;
+    }
+
+    size_type firstslot() const
+    {
+        const size_type n = keys.size();
+        size_type k = n ? 1 : 0;
+        while (k && 2 * k <= n)
+            k *= 2;
+        return k;
+    }
+
+    size_type nextslot(size_type k) const
+    {
+        const size_type n = keys.size();
+        if (2 * k + 1 <= n) {
+            k = 2 * k + 1;
+            while (2 * k <= n)
+                k *= 2;
+            return k;
+        }
+        while (k & 1)
+            k >>= 1;
+        return k >> 1;
+    }
+
+    // the previous of 0 (end) is the last slot
+    size_type prevslot(size_type k) const
+    {
+        const size_type n = keys.size();
+        if (!k || 2 * k <= n) {
+            k = k ? 2 * k : 1;
+            while (2 * k + 1 <= n)
+                k = 2 * k + 1;
+            return k;
+        }
+        while (!(k & 1))
+            k >>= 1;
+        return k >> 1;
+    }
+
+    Diff offset;
+    std::vector<Diff, KeyAllocator> keys;
+    std::vector<Type, ValueAllocator> values;
+};
+
+} //namespace
+
+namespace std {
+
+template <class K, class D, class T, class A>
+void swap(gununu::frozen_slidable_map<K,D,T,A>& lhs, gununu::frozen_slidable_map<K,D,T,A>& rhs) {
+    lhs.swap(rhs);
+}
+
+} //namespace std
+
+#endif /* FROZEN_SLIDABLE_MAP_HPP */
@@ -0,0 +1,511 @@
+#ifndef SLIDABLE_FLAT_MAP_HPP
+#define SLIDABLE_FLAT_MAP_HPP
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include <boost/config.hpp>
+
+namespace gununu {
+
+// slidable_map with the same interface whose elements are kept in sorted arrays, for maps which
+// are slid and searched often but rarely inserted into. insert and erase are O(N).
+// the slides are kept as deltas in a fenwick tree: the key of element i is keys[i] plus the sum
+// of the deltas up to i plus offset. so slide_rightkeys and slide_leftkeys are O(logN), and the
+// searches descend the fenwick tree together with the keys in O(logN).
+// the deltas are folded into keys by the next insert or erase, and by non-const begin(), so that
+// a scan after the slides runs over the plain arrays. const members never fold.
+template <class Key, class Diff, class Type, class Alloc = std::allocator<std::pair<const Key, Type> > >
+class slidable_flat_map : Alloc
+{
+public:
+typedef Key key_type;
+typedef Type mapped_type;
+typedef std::pair<const Key, Type> value_type;
+typedef Alloc allocator_type;
+typedef typename Alloc::size_type size_type;
+
+private:
+typedef typename Alloc::template rebind<Diff>::other KeyAllocator;
+typedef typename Alloc::template rebind<Type>::other ValueAllocator;
+typedef std::vector<Diff, KeyAllocator> key_array;
+typedef std::vector<Type, ValueAllocator> value_array;
+
+public:
+class const_iterator : public std::iterator<std::bidirectional_iterator_tag, value_type>
+{
+    friend class slidable_flat_map;
+protected:
+    const_iterator(const slidable_flat_map* c, size_type i) : container(c), index(i) {}
+public:
+    const_iterator() : container(NULL), index(0) {}
+
+    Key first() const { return container->keyof(index); }
+    const Type& second() const { return container->values[index]; }
+    const const_iterator& operator * () const { return *this; }
+    const const_iterator* operator -> () const { return this; }
+
+    const_iterator& operator ++ ()
+    {
+        ++index;
+        return *this;
+    }
+    const_iterator& operator -- ()
+    {
+        --index;
+        return *this;
+    }
+    const_iterator operator ++ (int)
+    {
+        const_iterator tmp = *this;
+        ++*this;
+        return tmp;
+    }
+    const_iterator operator -- (int)
+    {
+        const_iterator tmp = *this;
+        --*this;
+        return tmp;
+    }
+    friend bool operator == (const const_iterator& lhs, const const_iterator& rhs)
+    {
+        assert(lhs.container == rhs.container);
+        return lhs.index == rhs.index;
+    }
+    friend bool operator != (const const_iterator& lhs, const const_iterator& rhs)
+    {
+        return !(lhs == rhs);
+    }
+protected:
+    const slidable_flat_map* container;
+    size_type index;
+};
+
+class iterator : public const_iterator
+{
+    friend class slidable_flat_map;
+    friend class reverse_iterator;
+protected:
+    iterator(const slidable_flat_map* c, size_type i) : const_iterator(c, i) {}
+public:
+    iterator() {}
+
+    Type& second() const { return const_cast<slidable_flat_map*>(this->container)->values[this->index]; }
+    const iterator& operator * () const { return *this; }
+    const iterator* operator -> () const { return this; }
+
+    iterator& operator ++ ()
+    {
+        const_iterator::operator ++ ();
+        return *this;
+    }
+    iterator& operator -- ()
+    {
+        const_iterator::operator -- ();
+        return *this;
+    }
+    iterator operator ++ (int)
+    {
+        iterator tmp = *this;
+        ++*this;
+        return tmp;
+    }
+    iterator operator -- (int)
+    {
+        iterator tmp = *this;
+        --*this;
+        return tmp;
+    }
+};
+
+// walks the indices downwards. rend() is the index before 0, which wraps around.
+class const_reverse_iterator : public const_iterator
+{
+    friend class slidable_flat_map;
+protected:
+    const_reverse_iterator(const slidable_flat_map* c, size_type i) : const_iterator(c, i) {}
+public:
+    const_reverse_iterator() {}
+
+    const_iterator base() const { return const_iterator(this->container, this->index + 1); }
+    const const_reverse_iterator& operator * () const { return *this; }
+    const const_reverse_iterator* operator -> () const { return this; }
+
+    const_reverse_iterator& operator ++ ()
+    {
+        --this->index;
+        return *this;
+    }
+    const_reverse_iterator& operator -- ()
+    {
+        ++this->index;
+        return *this;
+    }
+    const_reverse_iterator operator ++ (int)
+    {
+        const_reverse_iterator tmp = *this;
+        ++*this;
+        return tmp;
+    }
+    const_reverse_iterator operator -- (int)
+    {
+        const_reverse_iterator tmp = *this;
+        --*this;
+        return tmp;
+    }
+};
+
+class reverse_iterator : public const_reverse_iterator
+{
+    friend class slidable_flat_map;
+protected:
+    reverse_iterator(const slidable_flat_map* c, size_type i) : const_reverse_iterator(c, i) {}
+public:
+    reverse_iterator() {}
+
+    iterator base() const { return iterator(this->container, this->index + 1); }
+    Type& second() const { return const_cast<slidable_flat_map*>(this->container)->values[this->index]; }
+    const reverse_iterator& operator * () const { return *this; }
+    const reverse_iterator* operator -> () const { return this; }
+
+    reverse_iterator& operator ++ ()
+    {
+        const_reverse_iterator::operator ++ ();
+        return *this;
+    }
+    reverse_iterator& operator -- ()
+    {
+        const_reverse_iterator::operator -- ();
+        return *this;
+    }
+    reverse_iterator operator ++ (int)
+    {
+        reverse_iterator tmp = *this;
+        ++*this;
+        return tmp;
+    }
+    reverse_iterator operator -- (int)
+    {
+        reverse_iterator tmp = *this;
+        --*this;
+        return tmp;
+    }
+};
+
+    explicit slidable_flat_map(const Alloc& a = Alloc())
+        : Alloc(a), offset(), keys((KeyAllocator(a))), deltas(1, Diff(), KeyAllocator(a)), values((ValueAllocator(a))), sloped(false) {}
+    template <class InputIt>
+    slidable_flat_map(InputIt first, InputIt last, const Alloc& a = Alloc())
+        : Alloc(a), offset(), keys((KeyAllocator(a))), deltas(1, Diff(), KeyAllocator(a)), values((ValueAllocator(a))), sloped(false)
+    {
+        insert(first, last);
+    }
+
+    void swap(slidable_flat_map& rhs)
+    {
+        std::swap(offset, rhs.offset);
+        keys.swap(rhs.keys);
+        deltas.swap(rhs.deltas);
+        values.swap(rhs.values);
+        std::swap(sloped, rhs.sloped);
+    }
+
+    Alloc       get_allocator() const { return static_cast<const Alloc&>(*this); }
+    bool        empty() const { return keys.empty(); }
+    size_type   size() const { return keys.size(); }
+    size_type   max_size() const { return std::min(keys.max_size(), values.max_size()); }
+    void        reserve(size_type n)
+    {
+        keys.reserve(n);
+        deltas.reserve(n + 1);
+        values.reserve(n);
+    }
+
+    // the non-const ones fold the pending slides into the keys first, O(N) once after slides.
+    // the const ones leave them, and first() stays O(logN) until the next fold.
+    iterator         begin() { fold(); return iterator(this, 0); }
+    const_iterator   begin() const { return const_iterator(this, 0); }
+    const_iterator  cbegin() const { return begin(); }
+    iterator         end() { return iterator(this, size()); }
+    const_iterator   end() const { return const_iterator(this, size()); }
+    const_iterator  cend() const { return end(); }
+    reverse_iterator         rbegin() { fold(); return reverse_iterator(this, size() - 1); }
+    const_reverse_iterator   rbegin() const { return const_reverse_iterator(this, size() - 1); }
+    const_reverse_iterator  crbegin() const { return rbegin(); }
+    reverse_iterator         rend() { return reverse_iterator(this, size_type(0) - 1); }
+    const_reverse_iterator   rend() const { return const_reverse_iterator(this, size_type(0) - 1); }
+    const_reverse_iterator  crend() const { return rend(); }
+
+    std::pair<iterator, bool> insert(const value_type& kv)
+    {
+        const Diff rlkey = kv.first - Key() - offset;
+        const size_type i = countbelow(rlkey, false);
+        if (i != size() && !(rlkey < rawkey(i)))
+            return std::make_pair(iterator(this, i), false);
+        fold();
+        deltas.push_back(Diff());
+        try {
+            keys.insert(keys.begin() + i, rlkey);
+            try {
+                values.insert(values.begin() + i, kv.second);
+            } catch (...) {
+                keys.erase(keys.begin() + i);
+                throw;
+            }
+        } catch (...) {
+            deltas.pop_back();
+            throw;
+        }
+        return std::make_pair(iterator(this, i), true);
+    }
+
+    template <class InputIt>
+    void insert(InputIt first, InputIt last)
+    {
+        for (; first != last; ++first)
+            insert(*first);
+    }
+
+    // inserts val at diff from the key of hint. it is the same as insert since the arrays are searched anyway.
+    std::pair<iterator, bool> insert_by(const_iterator hint, const Diff& diff, const Type& val)
+    {
+        assert(hint.container == this && hint.index < size());
+        Key k = hint->first();
+        k += diff;
+        return insert(value_type(k, val));
+    }
+
+    Type& operator [] (const Key& key)
+    {
+        return insert(value_type(key, Type())).first->second();
+    }
+
+    Type& at(const Key& key) {
+        iterator p = find(key);
+        if (p == end())
+            throw std::out_of_range("slidable_flat_map::at");
+        return p->second();
+    }
+    const Type& at(const Key& key) const {
+        return const_cast<slidable_flat_map*>(this)->at(key);
+    }
+
+    iterator erase(const_iterator where)
+    {
+        assert(where.container == this && where.index < size());
+        fold();
+        keys.erase(keys.begin() + where.index);
+        values.erase(values.begin() + where.index);
+        deltas.pop_back();
+        return iterator(this, where.index);
+    }
+
+    size_type erase(const Key& key)
+    {
+        iterator p = find(key);
+        if (p == end())
+            return 0;
+        erase(p);
+        return 1;
+    }
+
+    iterator erase(const_iterator first, const_iterator last)
+    {
+        assert(first.container == this && last.container == this && first.index <= last.index && last.index <= size());
+        fold();
+        keys.erase(keys.begin() + first.index, keys.begin() + last.index);
+        values.erase(values.begin() + first.index, values.begin() + last.index);
+        deltas.resize(size() + 1);
+        return iterator(this, first.index);
+    }
+
+    void clear()
+    {
+        keys.clear();
+        values.clear();
+        deltas.resize(1);
+        offset = Diff();
+        sloped = false;
+    }
+
+    iterator find(const Key& key)
+    {
+        const Diff rlkey = key - Key() - offset;
+        const size_type i = countbelow(rlkey, false);
+        if (i == size() || rlkey < rawkey(i))
+            return end();
+        return iterator(this, i);
+    }
+    const_iterator find(const Key& key) const { return const_cast<slidable_flat_map*>(this)->find(key); }
+
+    size_type count(const Key& key) const { return (find(key) != end()) ? 1 : 0; }
+
+    iterator lower_bound(const Key& key) { return iterator(this, countbelow(key - Key() - offset, false)); }
+    const_iterator lower_bound(const Key& key) const { return const_cast<slidable_flat_map*>(this)->lower_bound(key); }
+    iterator upper_bound(const Key& key) { return iterator(this, countbelow(key - Key() - offset, true)); }
+    const_iterator upper_bound(const Key& key) const { return const_cast<slidable_flat_map*>(this)->upper_bound(key); }
+
+    std::pair<iterator, iterator> equal_range(const Key& key)
+    {
+        iterator first = find(key);
+        iterator last = first;
+        if (first != end())
+            ++last;
+        return std::pair<iterator, iterator>(first, last);
+    }
+    std::pair<const_iterator, const_iterator> equal_range(const Key& key) const
+    {
+        std::pair<iterator, iterator> p = const_cast<slidable_flat_map*>(this)->equal_range(key);
+        return std::pair<const_iterator, const_iterator>(p.first, p.second);
+    }
+
+    // the nearest element whose key is not greater than key (less than key for rupper_bound), or end()
+    iterator rlower_bound(const Key& key) { return before(countbelow(key - Key() - offset, true)); }
+    const_iterator rlower_bound(const Key& key) const { return const_cast<slidable_flat_map*>(this)->rlower_bound(key); }
+    iterator rupper_bound(const Key& key) { return before(countbelow(key - Key() - offset, false)); }
+    const_iterator rupper_bound(const Key& key) const { return const_cast<slidable_flat_map*>(this)->rupper_bound(key); }
+
+    // lower_bound and rlower_bound with the key of the element. the key is Key() for end().
+    std::pair<iterator, Key> lower_bound2(const Key& key) { return withkey(lower_bound(key)); }
+    std::pair<const_iterator, Key> lower_bound2(const Key& key) const
+    {
+        std::pair<iterator, Key> ret = const_cast<slidable_flat_map*>(this)->lower_bound2(key);
+        return std::pair<const_iterator, Key>(ret.first, ret.second);
+    }
+    std::pair<iterator, Key> rlower_bound2(const Key& key) { return withkey(rlower_bound(key)); }
+    std::pair<const_iterator, Key> rlower_bound2(const Key& key) const
+    {
+        std::pair<iterator, Key> ret = const_cast<slidable_flat_map*>(this)->rlower_bound2(key);
+        return std::pair<const_iterator, Key>(ret.first, ret.second);
+    }
+
+    // the same as slidable_map: moves only the key of where. the order of the keys must not change.
+    void movekey(const_iterator where, const Diff& qty)
+    {
+        assert(where.container == this && where.index < size());
+        addfrom(where.index, qty);
+        addfrom(where.index + 1, Diff() - qty);
+    }
+
+    // the same as slidable_map: keys not less than bgn
+    void slide_rightkeys(const Key& bgn, const Diff& qty)
+    {
+        addfrom(countbelow(bgn - Key() - offset, false), qty);
+    }
+
+    // the same as slidable_map: keys not greater than bgn
+    void slide_leftkeys(const Key& bgn, const Diff& qty)
+    {
+        const size_type i = countbelow(bgn - Key() - offset, true);
+        if (!i)
+            return;
+        offset += qty;
+        addfrom(i, Diff() - qty);
+    }
+
+    void slide_all(const Diff& qty) { offset += qty; }
+
+    friend void swap(slidable_flat_map& lhs, slidable_flat_map& rhs) { lhs.swap(rhs); }
+
+private:
+    static size_type lowbit(size_type i) { return i & (~i + 1); }
+
+    // the element before the first n elements
+    iterator before(size_type n) { return n ? iterator(this, n - 1) : end(); }
+    std::pair<iterator, Key> withkey(const iterator& it)
+    {
+        return std::pair<iterator, Key>(it, it == end() ? Key() : it->first());
+    }
+
+    // adds qty to the keys of elements i and after.
+    void addfrom(size_type i, const Diff& qty)
+    {
+        const size_type n = size();
+        if (i == n)
+            return;
+        for (size_type j = i + 1; j <= n; j += lowbit(j))
+            deltas[j] += qty;
+        sloped = true;
+    }
+
+    // the key of element i without offset
+    Diff rawkey(size_type i) const
+    {
+        if (!sloped)
+            return keys[i];
+        Diff sum = keys[i];
+        for (size_type j = i + 1; j; j -= lowbit(j))
+            sum += deltas[j];
+        return sum;
+    }
+
+    Key keyof(size_type i) const
+    {
+        Key k = Key();
+        k += rawkey(i) + offset;
+        return k;
+    }
+
+    // the number of elements whose keys are less than rlkey (not greater than rlkey if upper).
+    // while slides are pending, the search descends the fenwick tree: deltas[pos + step]
+    // covers (pos, pos + step], so sum + deltas[pos + step] is the delta of element pos + step.
+    size_type countbelow(const Diff& rlkey, bool upper) const
+    {
+        if (!sloped) {
+            return upper ? std::upper_bound(keys.begin(), keys.end(), rlkey) - keys.begin()
+                         : std::lower_bound(keys.begin(), keys.end(), rlkey) - keys.begin();
+        }
+        const size_type n = size();
+        size_type step = 1;
+        while (step <= n / 2)
+            step *= 2;
+        size_type pos = 0;
+        Diff sum = Diff();
+        for (; step; step /= 2) {
+            const size_type j = pos + step;
+            if (j > n)
+                continue;
+            const Diff s = sum + deltas[j];
+            const Diff k = keys[j - 1] + s;
+            if (upper ? !(rlkey < k) : (k < rlkey)) {
+                pos = j;
+                sum = s;
+            }
+        }
+        return pos;
+    }
+
+    // adds the pending deltas to keys and clears them. no iterator is invalidated.
+    void fold()
+    {
+        if (!sloped)
+            return;
+        const size_type n = size();
+        for (size_type i = n; i; --i) {
+            if (i + lowbit(i) <= n)
+                deltas[i + lowbit(i)] -= deltas[i];
+        }
+        Diff sum = Diff();
+        for (size_type i = 1; i <= n; ++i) {
+            sum += deltas[i];
+            keys[i - 1] += sum;
+            deltas[i] = Diff();
+        }
+        sloped = false;
+    }
+
+    Diff offset;
+    key_array keys;
+    // fenwick tree of the slides, 1-based. deltas[0] is not used.
+    key_array deltas;
+    value_array values;
+    bool sloped;
+};
+
+} //namespace
+
+#endif /* SLIDABLE_FLAT_MAP_HPP */
@@ -0,0 +1,192 @@
+#ifndef SLIDABLE_INTERVAL_MAP_HPP
+#define SLIDABLE_INTERVAL_MAP_HPP
+
+#include <cassert>
+#include <utility>
+#include "slidable_map.hpp"
+
+namespace gununu {
+
+// the interval [start, start + length) which is stored with the start as its key
+template <class Diff, class Type>
+struct slidable_interval {
+    slidable_interval(const Diff& l, const Type& v) : length(l), value(v) {}
+    Diff length;
+    Type value;
+};
+
+namespace detail {
+// the greatest end of the intervals in a subtree, relative to the key of its top node,
+// so that a slide which moves a whole subtree leaves it as it is.
+template <class Diff>
+struct interval_augment : no_augment {
+    struct data {
+        data() : maxend() {}
+        Diff maxend;
+    };
+    static const bool aggregate = true;
+    static const bool keyed = true;
+
+    template <class Node>
+    static void update(Node* p) {
+        Diff maxend = p->value().length;
+        if (p->left) {
+            const Diff e = p->left->key + p->left->aug.maxend;
+            if (maxend < e)
+                maxend = e;
+        }
+        if (p->right) {
+            const Diff e = p->right->key + p->right->aug.maxend;
+            if (maxend < e)
+                maxend = e;
+        }
+        p->aug.maxend = maxend;
+    }
+};
+}
+
+// slidable_map of intervals which are keyed by their starts. an interval moves with its start
+// and keeps its length, so slide_rightkeys(bgn, qty) moves the intervals which start at bgn or
+// after, and the ones which started before keep their ends.
+// every subtree knows the greatest end in it, so the intervals which overlap a range are found
+// without visiting the subtrees which end before the range.
+// the length must not be changed through an iterator; erase and insert the interval instead.
+template <class Key, class Diff, class Type, class Alloc = std::allocator<std::pair<const Key, Type> > >
+class slidable_interval_map
+{
+public:
+typedef Key key_type;
+typedef slidable_interval<Diff, Type> mapped_type;
+typedef std::pair<const Key, mapped_type> value_type;
+
+private:
+typedef typename Alloc::template rebind<value_type>::other map_allocator;
+typedef slidable_map<Key, Diff, mapped_type, map_allocator, detail::interval_augment<Diff> > map_type;
+typedef typename map_type::node node;
+
+public:
+typedef typename map_type::allocator_type allocator_type;
+typedef typename map_type::size_type size_type;
+typedef typename map_type::iterator iterator;
+typedef typename map_type::const_iterator const_iterator;
+typedef typename map_type::reverse_iterator reverse_iterator;
+typedef typename map_type::const_reverse_iterator const_reverse_iterator;
+
+    slidable_interval_map() {}
+    explicit slidable_interval_map(const Alloc& a) : map(map_allocator(a)) {}
+
+    void swap(slidable_interval_map& rhs) { map.swap(rhs.map); }
+
+    allocator_type get_allocator() const { return map.get_allocator(); }
+    size_type   size() const { return map.size(); }
+    bool        empty() const { return map.empty(); }
+    size_type   max_size() const { return map.max_size(); }
+
+    iterator         begin() { return map.begin(); }
+    const_iterator   begin() const { return map.begin(); }
+    const_iterator  cbegin() const { return map.begin(); }
+    iterator         end() { return map.end(); }
+    const_iterator   end() const { return map.end(); }
+    const_iterator  cend() const { return map.end(); }
+    reverse_iterator         rbegin() { return map.rbegin(); }
+    const_reverse_iterator   rbegin() const { return map.rbegin(); }
+    reverse_iterator         rend() { return map.rend(); }
+    const_reverse_iterator   rend() const { return map.rend(); }
+
+    // inserts [lo, hi). returns the interval which starts at lo and false if there is one.
+    std::pair<iterator, bool> insert(const Key& lo, const Key& hi, const Type& value)
+    {
+        assert(!(hi < lo));
+        return map.insert(value_type(lo, mapped_type(hi - lo, value)));
+    }
+
+    iterator erase(const_iterator where) { return map.erase(where); }
+    size_type erase(const Key& lo) { return map.erase(lo); }
+    void clear() { map.clear(); }
+
+    // the intervals by their starts
+    iterator find(const Key& lo) { return map.find(lo); }
+    const_iterator find(const Key& lo) const { return map.find(lo); }
+    iterator lower_bound(const Key& lo) { return map.lower_bound(lo); }
+    const_iterator lower_bound(const Key& lo) const { return map.lower_bound(lo); }
+    iterator upper_bound(const Key& lo) { return map.upper_bound(lo); }
+    const_iterator upper_bound(const Key& lo) const { return map.upper_bound(lo); }
+
+    // writes the iterators of the intervals which overlap [lo, hi), that is, which start
+    // before hi and end after lo, to out in the order of their starts.
+    template <class OutputIt>
+    OutputIt overlapping(const Key& lo, const Key& hi, OutputIt out)
+    {
+        if (!(lo < hi))
+            return out;
+        return collect<iterator>(map.root, Diff(), lo - Key(), hi - Key(), false, out);
+    }
+    template <class OutputIt>
+    OutputIt overlapping(const Key& lo, const Key& hi, OutputIt out) const
+    {
+        if (!(lo < hi))
+            return out;
+        return collect<const_iterator>(map.root, Diff(), lo - Key(), hi - Key(), false, out);
+    }
+
+    // writes the iterators of the intervals which contain t to out in the order of their starts.
+    template <class OutputIt>
+    OutputIt at(const Key& t, OutputIt out)
+    {
+        return collect<iterator>(map.root, Diff(), t - Key(), t - Key(), true, out);
+    }
+    template <class OutputIt>
+    OutputIt at(const Key& t, OutputIt out) const
+    {
+        return collect<const_iterator>(map.root, Diff(), t - Key(), t - Key(), true, out);
+    }
+
+    // the same as slidable_map. the intervals move with their starts.
+    void slide_rightkeys(const Key& bgn, const Diff& qty) { map.slide_rightkeys(bgn, qty); }
+    void slide_leftkeys(const Key& bgn, const Diff& qty) { map.slide_leftkeys(bgn, qty); }
+    void slide_all(const Diff& qty) { map.slide_all(qty); }
+
+    bool check_structure() const { return map.check_structure(); }
+
+    friend void swap(slidable_interval_map& lhs, slidable_interval_map& rhs) { lhs.swap(rhs); }
+
+private:
+    // visits the subtree of p in order and writes the nodes to out as It. base is the key of the
+    // parent of p. a subtree is skipped if it ends before lo, and the right subtree of a node
+    // which starts after hi (not before hi unless closed) is skipped.
+    template <class It, class OutputIt>
+    OutputIt collect(node* p, Diff base, const Diff& lo, const Diff& hi, bool closed, OutputIt out) const
+    {
+        while (p) {
+            const Diff start = base + p->key;
+            if (!(lo < start + p->aug.maxend))
+                break;
+            out = collect<It>(p->left, start, lo, hi, closed, out);
+            if (closed ? (hi < start) : !(start < hi))
+                break;
+            if (lo < start + p->value().length) {
+                *out = It(map.iteratorof(p));
+                ++out;
+            }
+            // the right subtree is visited by the loop
+            base = start;
+            p = p->right;
+        }
+        return out;
+    }
+
+    map_type map;
+};
+
+} //namespace
+
+namespace std {
+
+template <class K, class D, class T, class A>
+void swap(gununu::slidable_interval_map<K,D,T,A>& lhs, gununu::slidable_interval_map<K,D,T,A>& rhs) {
+    lhs.swap(rhs);
+}
+
+} //namespace std
+
+#endif /* SLIDABLE_INTERVAL_MAP_HPP */
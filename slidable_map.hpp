@@ -4,14 +4,27 @@
 
 #include <algorithm>
 #include <functional>
+#include <limits>
 #include <memory>
 #include <cassert>
 #include <stdexcept>
 #include <utility>
+#include <vector>
 #include <boost/config.hpp>
+#include <boost/static_assert.hpp>
 
 namespace gununu {
 
+template <class T, class Allocator, class Weight, class KeyStorage>
+class anywhere_deque;
+
+template <class Key, class Diff, class Type, class Alloc>
+class frozen_slidable_map;
+template <class Key, class Diff, class Type, class Alloc>
+class slidable_interval_map;
+template <class Key, class Diff, class Type, class Alloc>
+class slidable_timer_queue;
+
 namespace detail {
 //for exception-safty
 template <class T, size_t N>
@@ -37,35 +50,365 @@ private:
     size_t num;
 };
 
-template <class Diff, class Type>
-struct node_base {
+// hints that p is going to be read soon
+inline void prefetch(const void* p) {
+#ifdef __GNUC__
+    __builtin_prefetch(p);
+#else
+    (void)p;
+#endif
+}
+
+// extra node data.
+// push() is called before children of a node are visited and has to bring the children up to date.
+// it is called only if 'lazy' is true.
+// update() is called after children of a node are changed and has to recalculate the data
+// from the children. it is called only if 'aggregate' is true.
+// if push() changes the values of the children, 'lazy_values' has to be true so that
+// the ancestors of a node are pushed before its value is read through an iterator.
+// if update() reads the relative keys of the children, 'keyed' has to be true so that the slides
+// recalculate the nodes whose subtrees were moved in part.
+struct no_augment {
+    struct data {};
+    static const bool lazy = false;
+    static const bool lazy_values = false;
+    static const bool aggregate = false;
+    static const bool keyed = false;
+    template <class Node>
+    static void push(Node*) {}
+    template <class Node>
+    static void update(Node*) {}
+};
+
+// in-order links of a node. they are kept only by the threaded layout.
+template <class Node, bool Threaded>
+struct thread_links {
+    static Node* succ(const Node*) { return NULL; }
+    static Node* pred(const Node*) { return NULL; }
+    static void link(Node*, Node*) {}
+};
+
+template <class Node>
+struct thread_links<Node, true> {
+    thread_links() : prevnode(NULL), nextnode(NULL) {}
+    static Node* succ(const Node* p) { return p->nextnode; }
+    static Node* pred(const Node* p) { return p->prevnode; }
+    static void link(Node* l, Node* r) {
+        if (l) l->nextnode = r;
+        if (r) r->prevnode = l;
+    }
+
+    Node* prevnode;
+    Node* nextnode;
+};
+
+// the value of a node. make() turns a value into the argument of the constructor,
+// and release() frees what make() allocated.
+template <class Type, bool Separate>
+struct value_slot {
+#ifndef BOOST_NO_RVALUE_REFERENCES
+    template <class V>
+    explicit value_slot(V&& v) : val(std::forward<V>(v)) {}
+    template <class A, class V>
+    static V&& make(A&, V&& v) { return std::forward<V>(v); }
+#else
+    explicit value_slot(const Type& v) : val(v) {}
+    template <class A>
+    static const Type& make(A&, const Type& v) { return v; }
+#endif
+    template <class A>
+    void release(A&) {}
+    Type& value() { return val; }
+    const Type& value() const { return val; }
+
+    Type val;
+};
+
+// the value is allocated apart from the node so that a search reads only small nodes.
+template <class Type>
+struct value_slot<Type, true> {
+    explicit value_slot(Type* p) : pval(p) {}
+#ifndef BOOST_NO_RVALUE_REFERENCES
+    template <class A, class V>
+    static Type* make(A& a, V&& v)
+#else
+    template <class A>
+    static Type* make(A& a, const Type& v)
+#endif
+    {
+        Type* p = a.allocate(1);
+        try {
+#ifndef BOOST_NO_RVALUE_REFERENCES
+            new ((void*)p) Type(std::forward<V>(v));
+#else
+            new ((void*)p) Type(v);
+#endif
+        } catch (...) {
+            a.deallocate(p, 1);
+            throw;
+        }
+        return p;
+    }
+    template <class A>
+    void release(A& a) {
+        pval->~Type();
+        a.deallocate(pval, 1);
+    }
+    Type& value() { return *pval; }
+    const Type& value() const { return *pval; }
+
+    Type* pval;
+};
+
+// a relative key stored in Narrow. the map keeps the keys where every relative key fits,
+// which is checked here only by assert.
+template <class Diff, class Narrow>
+class narrow_diff {
+public:
+    narrow_diff(const Diff& d) : v(narrow(d)) {}
+    narrow_diff& operator = (const Diff& d) { v = narrow(d); return *this; }
+    narrow_diff& operator += (const Diff& d) { v = narrow(Diff(v) + d); return *this; }
+    narrow_diff& operator -= (const Diff& d) { v = narrow(Diff(v) - d); return *this; }
+    operator Diff () const { return Diff(v); }
+private:
+    static Narrow narrow(const Diff& d) {
+        assert(Diff(std::numeric_limits<Narrow>::min()) <= d && d <= Diff(std::numeric_limits<Narrow>::max()));
+        return static_cast<Narrow>(d);
+    }
+    Narrow v;
+};
+
+template <class Diff, class Type, class Augment = no_augment, bool Threaded = false, bool Separate = false, class StoredDiff = Diff>
+struct node_base : thread_links<node_base<Diff,Type,Augment,Threaded,Separate,StoredDiff>, Threaded> {
     typedef unsigned char color;
-    node_base(node_base* p, node_base* l, node_base* r, color c, const Diff& k, const Type& t)
-        :left(l), right(r), parent(p), col(c), key(k), val(t){}
+    typedef value_slot<Type, Separate> slot;
 #ifndef BOOST_NO_RVALUE_REFERENCES
-    node_base(node_base* p, node_base* l, node_base* r, color c, const Diff& k, Type&& t)
-        :left(l), right(r), parent(p), col(c), key(k), val(std::move(t)){}
+    template <class V>
+    node_base(node_base* p, node_base* l, node_base* r, color c, const Diff& k, V&& v)
+        :left(l), right(r), parent(p), col(c), key(k), storage(std::forward<V>(v)){}
+#else
+    template <class V>
+    node_base(node_base* p, node_base* l, node_base* r, color c, const Diff& k, const V& v)
+        :left(l), right(r), parent(p), col(c), key(k), storage(v){}
 #endif
-    node_base(const node_base& rhs) : col(rhs.col), key(rhs.key), val(rhs.val) {}
+
+    Type& value() { return storage.value(); }
+    const Type& value() const { return storage.value(); }
 
     node_base* left;
     node_base* right;
     node_base* parent;
     color col;
+    typename Augment::data aug;
 
-    Diff key;
-    Type val;
+    StoredDiff key;
+    slot storage;
 };
 }
 
-template <class Key, class Diff, class Type, class Alloc = std::allocator<std::pair<const Key, Type> > >
-class slidable_map : Alloc::template rebind<detail::node_base<Diff,Type> >::other, Alloc
+// Augment policy that enables scale_rightkeys() and scale_range().
+// a pending factor is kept on each subtree and multiplied into the keys of the children on descent.
+// Diff * Factor has to be convertible to Diff exactly, e.g. floating point Diff or integral Factor.
+template <class Factor = double>
+struct key_scaling : detail::no_augment {
+    struct data {
+        data() : factor(1) {}
+        Factor factor;
+    };
+    static const bool lazy = true;
+
+    template <class Node>
+    static void scale(Node* p, const Factor& f) {
+        p->aug.factor = p->aug.factor * f;
+    }
+    template <class Node>
+    static void push(Node* p) {
+        if (p->aug.factor == Factor(1))
+            return;
+        if (p->left) {
+            multiply(p->left->key, p->aug.factor);
+            scale(p->left, p->aug.factor);
+        }
+        if (p->right) {
+            multiply(p->right->key, p->aug.factor);
+            scale(p->right, p->aug.factor);
+        }
+        p->aug.factor = Factor(1);
+    }
+private:
+    template <class Diff>
+    static void multiply(Diff& d, const Factor& f) {
+        d = static_cast<Diff>(d * f);
+    }
+};
+
+// Augment policy that enables update_range().
+// Update is a function object that changes a value by 'void operator () (Type&) const'.
+// a default constructed Update has to do nothing, and 'a.then(b)' has to make 'a'
+// do what a and b do in this order. they must not throw.
+template <class Update>
+struct lazy_update : detail::no_augment {
+    struct data {
+        data() : pending(false) {}
+        bool pending;
+        Update update;
+    };
+    static const bool lazy = true;
+    static const bool lazy_values = true;
+
+    // applies f to the value of p and leaves it pending for the children
+    template <class Node>
+    static void apply(Node* p, const Update& f) {
+        f(p->value());
+        if (!p->left && !p->right)
+            return;
+        if (p->aug.pending) {
+            p->aug.update.then(f);
+        } else {
+            p->aug.update = f;
+            p->aug.pending = true;
+        }
+    }
+    template <class Node>
+    static void push(Node* p) {
+        if (!p->aug.pending)
+            return;
+        if (p->left)
+            apply(p->left, p->aug.update);
+        if (p->right)
+            apply(p->right, p->aug.update);
+        p->aug.pending = false;
+        p->aug.update = Update();
+    }
+};
+
+// Augment policy that enables find_gap() and largest_gap().
+// every subtree keeps its first and last keys relative to its top node and the greatest gap
+// between consecutive keys in it, so they stay as they are when the whole subtree is slid.
+template <class Diff>
+struct gap_search : detail::no_augment {
+    struct data {
+        data() : first(), last(), gap() {}
+        Diff first;
+        Diff last;
+        Diff gap;
+    };
+    static const bool aggregate = true;
+    static const bool keyed = true;
+
+    template <class Node>
+    static void update(Node* p) {
+        Diff first = Diff(), last = Diff(), gap = Diff();
+        if (p->left) {
+            first = p->left->key + p->left->aug.first;
+            gap = p->left->aug.gap;
+            const Diff g = Diff() - (p->left->key + p->left->aug.last);
+            if (gap < g)
+                gap = g;
+        }
+        if (p->right) {
+            last = p->right->key + p->right->aug.last;
+            if (gap < p->right->aug.gap)
+                gap = p->right->aug.gap;
+            const Diff g = p->right->key + p->right->aug.first;
+            if (gap < g)
+                gap = g;
+        }
+        p->aug.first = first;
+        p->aug.last = last;
+        p->aug.gap = gap;
+    }
+};
+
+// Search policies. with root_search every search starts from the root.
+// with finger_search a search climbs from the node found last to the lowest ancestor whose
+// subtree holds the key. it is short when the key is in a small subtree around the previous one,
+// but the tree has no level links, so two neighbours on both sides of the root still cost O(logN).
+// the balancing is the same, and the finger is forgotten whenever keys or nodes are removed or moved.
+// only non-const members move the finger, so const members may be called concurrently.
+struct root_search {
+    static const bool finger = false;
+};
+struct finger_search {
+    static const bool finger = true;
+};
+
+// Threading policies. with threaded every node also links to its in-order neighbours,
+// so that an iterator steps in O(1) without climbing to the parents.
+// it costs two pointers per node and can not be used with an Augment that reverses subtrees.
+struct unthreaded {
+    static const bool links = false;
+};
+struct threaded {
+    static const bool links = true;
+};
+
+// ValueLayout policies. with separate_values the values are allocated apart from the nodes,
+// so that searches and slides walk only the nodes, which hold the links and the keys.
+// it costs one pointer and one allocation per element.
+struct inline_values {
+    static const bool separate = false;
+};
+struct separate_values {
+    static const bool separate = true;
+};
+
+// KeyStorage policies. with narrow_keys the relative keys are stored in Narrow, e.g. boost::int32_t
+// for 64 bit Diff, so that the key shares the padding after the color and the node gets smaller.
+// every key has to stay within half the range of Narrow from Key() so that the difference of any
+// two keys fits. operations that would add or move a key out of it throw std::overflow_error
+// before changing anything. Diff has to be a signed arithmetic type.
+struct wide_keys {
+    static const bool narrow = false;
+    template <class Diff>
+    struct stored { typedef Diff type; };
+    template <class Diff>
+    static Diff max_key() { return (std::numeric_limits<Diff>::max)(); }
+    template <class Diff>
+    static bool fits(const Diff&) { return true; }
+};
+template <class Narrow>
+struct narrow_keys {
+    static const bool narrow = true;
+    template <class Diff>
+    struct stored { typedef detail::narrow_diff<Diff, Narrow> type; };
+    // the greatest key from Key() which fits
+    template <class Diff>
+    static Diff max_key() { return Diff(std::numeric_limits<Narrow>::max() / 2); }
+    template <class Diff>
+    static bool fits(const Diff& k) {
+        const Diff half = max_key<Diff>();
+        return !(k < -half) && !(half < k);
+    }
+};
+
+// Balance policies. red_black_balance keeps the tree red-black. avl_balance keeps the heights of
+// the two subtrees of every node within one, so the tree is at most about 1.44logN deep instead of
+// 2logN and lookups visit fewer nodes, while inserts and erases rotate more often. the height is
+// kept in the color byte, so the node does not grow. both rebalance with the same rotations, which
+// keep the relative keys, and concat() and split_at() work with either.
+// a self-adjusting (splay) tree is not offered: it would restructure the tree on const searches,
+// which may be called concurrently.
+struct red_black_balance {
+    static const bool avl = false;
+};
+struct avl_balance {
+    static const bool avl = true;
+};
+
+template <class Key, class Diff, class Type, class Alloc = std::allocator<std::pair<const Key, Type> >, class Augment = detail::no_augment, class Search = root_search, class Threading = unthreaded, class ValueLayout = inline_values, class KeyStorage = wide_keys, class Balance = red_black_balance>
+class slidable_map : Alloc::template rebind<detail::node_base<Diff,Type,Augment,Threading::links,ValueLayout::separate,typename KeyStorage::template stored<Diff>::type> >::other, Alloc
 {
 friend class const_iterator;
 friend class iterator;
-typedef detail::node_base<Diff,Type> node;
+template <class,class,class,class> friend class anywhere_deque;
+template <class,class,class,class> friend class frozen_slidable_map;
+template <class,class,class,class> friend class slidable_interval_map;
+template <class,class,class,class> friend class slidable_timer_queue;
+typedef detail::node_base<Diff,Type,Augment,Threading::links,ValueLayout::separate,typename KeyStorage::template stored<Diff>::type> node;
 typedef typename Alloc::template rebind<node>::other NodeAllocator;
 typedef Alloc ValueAllocator;
+typedef typename Alloc::template rebind<Type>::other TypeAllocator;
 
 public:
 typedef Key key_type;
@@ -85,6 +428,15 @@ protected:
         wp.pnode = NULL;
         wp.container = NULL;
     }
+    iterator_base(const iterator_base& rhs) {
+        wp.pnode = rhs.wp.pnode;
+        wp.container = rhs.wp.container;
+    }
+    iterator_base& operator = (const iterator_base& rhs) {
+        wp.pnode = rhs.wp.pnode;
+        wp.container = rhs.wp.container;
+        return *this;
+    }
     iterator_base(typename slidable_map::node* ptr, const slidable_map* container) {
         wp.pnode = ptr;
         wp.container = container;
@@ -102,6 +454,7 @@ protected:
         wrapper(const wrapper&);// = delete;
         wrapper& operator = (const wrapper&);// = delete;
     public:
+        wrapper() {}
         Key first() const {
             assert(this->container && this->pnode);
             return slidable_map::getabkey(this->pnode);
@@ -109,16 +462,22 @@ protected:
         
         Type& second() {
             assert(this->container && this->pnode);
-            return this->pnode->val;
+            if (Augment::lazy_values)
+                slidable_map::pushpath(this->pnode);
+            return this->pnode->value();
         }
         const Type& second() const {
             assert(this->container && this->pnode);
-            return this->pnode->val;
+            if (Augment::lazy_values)
+                slidable_map::pushpath(this->pnode);
+            return this->pnode->value();
         }
 
         operator std::pair<const Key, Type>() const
         {
-            return std::make_pair(slidable_map::getabkey(this->pnode), this->pnode->val);
+            if (Augment::lazy_values)
+                slidable_map::pushpath(this->pnode);
+            return std::make_pair(slidable_map::getabkey(this->pnode), this->pnode->value());
         }
     };
 public:
@@ -143,7 +502,7 @@ protected:
             wp.pnode = previous(wp.pnode);
         }
     }
-    wrapper_base wp;
+    wrapper wp;
 };
 class const_iterator : public iterator_base
 {
@@ -311,15 +670,15 @@ public:
 };
 
 public:
-    slidable_map(void) : root(NULL), rightmost(NULL), leftmost(NULL), mysize(0) {}
-    explicit slidable_map(const Alloc& a) : NodeAllocator(a), ValueAllocator(a), root(NULL), rightmost(NULL), leftmost(NULL), mysize(0) {}
-    slidable_map(const slidable_map& rhs) : NodeAllocator(rhs), ValueAllocator(rhs) {
+    slidable_map(void) : root(NULL), rightmost(NULL), leftmost(NULL), mysize(0), finger(NULL), tail(NULL) {}
+    explicit slidable_map(const Alloc& a) : NodeAllocator(a), ValueAllocator(a), root(NULL), rightmost(NULL), leftmost(NULL), mysize(0), finger(NULL), tail(NULL) {}
+    slidable_map(const slidable_map& rhs) : NodeAllocator(rhs), ValueAllocator(rhs), finger(NULL), tail(NULL) {
         root = copynodes(NULL, rhs.root);
         leftmost = getleftmost(root);
         rightmost = getrightmost(root);
         mysize = rhs.mysize; 
     }
-    slidable_map(const slidable_map& rhs, const Alloc& a): NodeAllocator(a), ValueAllocator(a) { 
+    slidable_map(const slidable_map& rhs, const Alloc& a): NodeAllocator(a), ValueAllocator(a), finger(NULL), tail(NULL) {
         root = copynodes(NULL, rhs.root);
         leftmost = getleftmost(root);
         rightmost = getrightmost(root);
@@ -328,14 +687,14 @@ public:
     ~slidable_map(void) { clear(); }
     
     template <class InputItr>
-    slidable_map(InputItr first, InputItr last) : root(NULL), rightmost(NULL), leftmost(NULL), mysize(0)
+    slidable_map(InputItr first, InputItr last) : root(NULL), rightmost(NULL), leftmost(NULL), mysize(0), finger(NULL), tail(NULL)
     {
         insert(first, last);
     }
     
 #ifndef BOOST_NO_RVALUE_REFERENCES
-    slidable_map(slidable_map&& rhs) : NodeAllocator(rhs), ValueAllocator(rhs), root(NULL), rightmost(NULL), leftmost(NULL), mysize(0) { swap(rhs); }
-    slidable_map(slidable_map&& rhs, const Alloc& a) : NodeAllocator(rhs), ValueAllocator(rhs), root(NULL), rightmost(NULL), leftmost(NULL), mysize(0) { swap(rhs); }
+    slidable_map(slidable_map&& rhs) : NodeAllocator(rhs), ValueAllocator(rhs), root(NULL), rightmost(NULL), leftmost(NULL), mysize(0), finger(NULL), tail(NULL) { swap(rhs); }
+    slidable_map(slidable_map&& rhs, const Alloc& a) : NodeAllocator(rhs), ValueAllocator(rhs), root(NULL), rightmost(NULL), leftmost(NULL), mysize(0), finger(NULL), tail(NULL) { swap(rhs); }
     slidable_map& operator = (slidable_map&& rhs) {
         assert(this != &rhs);
         static_cast<NodeAllocator&>(*this) = std::move(static_cast<NodeAllocator&>(rhs));
@@ -354,7 +713,7 @@ public:
 #endif
     
 #ifndef BOOST_NO_UNIFIED_INITIALIZETION_SYNTAX
-    slidable_map(std::initializer_list<value_type> list) : root(NULL), rightmost(NULL), leftmost(NULL), mysize(0)
+    slidable_map(std::initializer_list<value_type> list) : root(NULL), rightmost(NULL), leftmost(NULL), mysize(0), finger(NULL), tail(NULL)
     {
         insert(list.begin(), list.end());
     }
@@ -387,10 +746,15 @@ public:
         assert(hint.wp.pnode && hint.wp.container == this);
 
         node* self = hint.wp.pnode;
+        if (KeyStorage::narrow)
+            checkkey(getabkey(self) - Key() + diff);
+        pushpath(self);
+        push(self);
         if(Diff() < diff) {
             if (self->right) {
                 self = self->right;
                 while(true) {
+                    push(self);
                     diff -= self->key;
                     if (!self->left)
                         break;
@@ -401,6 +765,7 @@ public:
             if (self->left) {
                 self = self->left;
                 while(true) {
+                    push(self);
                     diff -= self->key;
                     if (!self->right)
                         break;
@@ -419,17 +784,48 @@ public:
         return std::pair<iterator, bool>(iterator(child, this), true);
     }
 
+    // the same as insert(), but an element whose key is greater than the last key is linked
+    // after the last one without searching from the root. the key of the last element is
+    // remembered, so appending keys in increasing order is amortized O(1) unless Augment aggregates.
+#ifndef BOOST_NO_RVALUE_REFERENCES
+    template <class P>
+    std::pair<iterator, bool> append(P&& kv)
+    {
+        auto ret = appendnode(kv.first, std::forward<P>(kv).second);
+        return std::pair<iterator, bool>(iterator(ret.first, this), ret.second);
+    }
+#endif
+
+    std::pair<iterator, bool> append(const value_type& kv)
+    {
+        std::pair<node*,bool> ret = appendnode(kv.first, kv.second);
+        return std::pair<iterator, bool>(iterator(ret.first, this), ret.second);
+    }
+
+    // appends the elements of a range in order, O(k + logN) if the range is sorted and
+    // greater than the last key. the others are inserted as by insert().
+    template <class InputItr>
+    void append(InputItr first, InputItr last)
+    {
+        for (; first != last; ++first)
+            append(*first);
+    }
+
     Type& operator [] (const Key& key)
     {
-        return insertnode(key, Type()).first->val;
+        return insertnode(key, Type()).first->value();
     }
 
     const Type& at(const Key& key) const {
-        return const_cast<slidable_map*>(this)->at(key);
+        if (node* p = findnode(key, false)) {
+            return p->value();
+        } else {
+            throw std::out_of_range("slidable_map::at");
+        }
     }
     Type& at(const Key& key) {
-        if (node* p = findnode(key)) {
-            return p->val;
+        if (node* p = findnode(key, true)) {
+            return p->value();
         } else {
             throw std::out_of_range("slidable_map::at");
         }
@@ -443,6 +839,7 @@ public:
             
             node* tmp = copynodes(NULL, rhs.root);
             recursive_erase(root);
+            forget();
             root = tmp;
             leftmost = getleftmost(root);
             rightmost = getrightmost(root);
@@ -462,7 +859,7 @@ public:
 
     size_type erase(const Key& key)
     {
-        node* tmp = findnode(key);
+        node* tmp = findnode(key, true);
         if (!tmp)
             return 0;
         erasenode(tmp);
@@ -488,15 +885,22 @@ public:
         recursive_erase(root);
         root = leftmost = rightmost = NULL;
         mysize = 0;
+        forget();
     }
 
     void slide_rightkeys(const Key& bgn, const Diff& qty)
     {
+        if (KeyStorage::narrow)
+            checkslide(bgn - Key(), qty, true);
+        forget();
         node* p = root;
+        node* last = NULL;
         Diff rlbgn = bgn - Key();
         while(1) {
             while(true) {
-                if (!p) return;
+                if (!p) { slid(last); return; }
+                push(p);
+                last = p;
                 if (!(p->key < rlbgn))
                     break;
                 rlbgn -= p->key;
@@ -507,7 +911,9 @@ public:
             p = p->left;
             
             while(true) {
-                if (!p) return;
+                if (!p) { slid(last); return; }
+                push(p);
+                last = p;
                 if (p->key < rlbgn)
                     break;
                 rlbgn -= p->key;
@@ -521,24 +927,36 @@ public:
     
     void slide_leftkeys(const Key& bgn, const Diff& qty)
     {
+        if (KeyStorage::narrow)
+            checkslide(bgn - Key(), qty, false);
+        forget();
         node* p = root;
+        node* last = NULL;
         Diff rlbgn = bgn - Key();
         while(1) {
-            if (!p) return;
+            if (!p) { slid(last); return; }
+            push(p);
+            last = p;
             while(rlbgn < p->key) {
                 rlbgn -= p->key;
                 p = p->left;
-                if (!p) return;    
+                if (!p) { slid(last); return; }    
+                push(p);
+                last = p;
             }
             rlbgn -= p->key;
             p->key += qty;
             p = p->right;
-            if (!p) return;
+            if (!p) { slid(last); return; }
+            push(p);
+            last = p;
 
             while(!(rlbgn < p->key)) {
                 rlbgn -= p->key;
                 p = p->right;
-                if (!p) return;    
+                if (!p) { slid(last); return; }    
+                push(p);
+                last = p;
             }
             rlbgn -= p->key;
             p->key -= qty;
@@ -546,9 +964,83 @@ public:
         }
     }
     
+    // every key k not less than bgn becomes bgn + (k - bgn) * factor.
+    // factor has to be positive. Augment has to provide scale(), e.g. key_scaling.
+    template <class Factor>
+    void scale_rightkeys(const Key& bgn, const Factor& factor)
+    {
+        assert(Factor(0) < factor);
+        if (KeyStorage::narrow)
+            checkscale(bgn - Key(), NULL, factor);
+        forget();
+        scalenodes(root, Diff(), Diff(), NULL, NULL, bgn - Key(), NULL, factor);
+    }
+
+    // every key k in [lo, hi) becomes lo + (k - lo) * factor, and the keys not less than hi
+    // are slid by (hi - lo) * factor - (hi - lo) so that the order is kept.
+    template <class Factor>
+    void scale_range(const Key& lo, const Key& hi, const Factor& factor)
+    {
+        assert(Factor(0) < factor);
+        assert(!(hi < lo));
+        const Diff rlhi = hi - Key();
+        if (KeyStorage::narrow)
+            checkscale(lo - Key(), &rlhi, factor);
+        forget();
+        scalenodes(root, Diff(), Diff(), NULL, NULL, lo - Key(), &rlhi, factor);
+    }
+
+    // applies f to every value whose key is in [lo, hi).
+    // Augment has to provide apply(), e.g. lazy_update.
+    template <class Update>
+    void update_range(const Key& lo, const Key& hi, const Update& f)
+    {
+        assert(!(hi < lo));
+        updatenodes(root, Diff(), NULL, NULL, lo - Key(), hi - Key(), f);
+    }
+
+    // returns the first element whose key is not less than after and whose next key is at
+    // least len away. the last element is returned if no gap between the keys is long enough,
+    // and end() if every key is less than after. Augment has to be gap_search.
+    iterator find_gap(const Key& after, const Diff& len)
+    {
+        const Diff rlafter = after - Key();
+        node* p = gapnode(root, Diff(), rlafter, len);
+        if (!p && root && !(getabkey(rightmost) - Key() < rlafter))
+            p = rightmost;
+        return iterator(p, this);
+    }
+    const_iterator find_gap(const Key& after, const Diff& len) const
+    {
+        return const_cast<slidable_map*>(this)->find_gap(after, len);
+    }
+
+    // returns the longest distance between consecutive points of lo, the keys in [lo, hi] and hi,
+    // that is, the longest free span in [lo, hi]. Augment has to be gap_search.
+    Diff largest_gap(const Key& lo, const Key& hi) const
+    {
+        assert(!(hi < lo));
+        const Diff rllo = lo - Key(), rlhi = hi - Key();
+        gap_span span;
+        gapspan(root, Diff(), rllo, rlhi, span);
+        if (!span.any)
+            return rlhi - rllo;
+        Diff gap = span.gap;
+        if (gap < span.first - rllo)
+            gap = span.first - rllo;
+        if (gap < rlhi - span.last)
+            gap = rlhi - span.last;
+        return gap;
+    }
+
     void slide_all(const Diff& qty) {
         if (!root)
             return;
+        if (KeyStorage::narrow) {
+            checkkey(getabkey(leftmost) - Key() + qty);
+            checkkey(getabkey(rightmost) - Key() + qty);
+        }
+        forget();
         root->key += qty;
     }
 
@@ -565,222 +1057,96 @@ public:
     const_reverse_iterator   rend() const { return const_cast<slidable_map*>(this)->rend(); }
     const_reverse_iterator  crend() const { return rend(); }
 
-    iterator        find(const Key& key) { return iterator(findnode(key), this); }
-    const_iterator  find(const Key& key) const { return const_iterator(findnode(key), this); }
+    iterator        find(const Key& key) { return iterator(findnode(key, true), this); }
+    const_iterator  find(const Key& key) const { return const_iterator(findnode(key, false), this); }
 
     size_type count(const key_type& key) const { return (find(key) != end()) ? 1 : 0; }
 
-    iterator lower_bound(const Key& key)
-    {
-        node* p = root;
-        if (!p)
-            return iterator(NULL, this);
+    iterator lower_bound(const Key& key) { return iterator(lowerbound(key, true), this); }
+    const_iterator lower_bound(const Key& key) const { return const_iterator(lowerbound(key, false), this); }
 
-        Diff rlkey = key - Key();
-        while(1) { 
-            if (p->key < rlkey) {
-                if (!p->right) {
-                    return iterator(next(p), this);
-                }
-                rlkey -= p->key;
-                p = p->right;
-            } else if (rlkey < p->key) {
-                if (!p->left) {
-                    return iterator(p, this);
-                }
-                rlkey -= p->key;
-                p = p->left;
-            } else {
-                return iterator(p, this);
-            }
-        }
-    }
-    const_iterator lower_bound(const Key& key) const
-    {
-        return const_cast<slidable_map*>(this)->lower_bound(key);
-    }
+    iterator upper_bound(const Key& key) { return iterator(upperbound(key, true), this); }
+    const_iterator upper_bound(const Key& key) const { return const_iterator(upperbound(key, false), this); }
 
-    iterator upper_bound(const Key& key)
-    {
-        node* p = root;
-        if (!p)
-            return iterator(NULL, this);
+    iterator rlower_bound(const Key& key) { return iterator(rlowerbound(key, true), this); }
+    const_iterator rlower_bound(const Key& key) const { return const_iterator(rlowerbound(key, false), this); }
+    
+    iterator rupper_bound(const Key& key) { return iterator(rupperbound(key, true), this); }
+    const_iterator rupper_bound(const Key& key) const { return const_iterator(rupperbound(key, false), this); }
 
-        Diff rlkey = key - Key();
-        while(1) {
-            if (p->key < rlkey) {
-                if (!p->right) {
-                    return iterator(next(p), this);
-                }
-                rlkey -= p->key;
-                p = p->right;
-            } else if (rlkey < p->key) {
-                if (!p->left) {
-                    return iterator(p, this);
-                }
-                rlkey -= p->key;
-                p = p->left;
-            } else {
-                return iterator(next(p), this);
-            }
-        }
+    std::pair<iterator, Key> lower_bound2(const Key& key)
+    {
+        std::pair<node*, Key> ret = lowerbound2(key, true);
+        return std::pair<iterator, Key>(iterator(ret.first, this), ret.second);
     }
-    const_iterator upper_bound(const Key& key) const
+    std::pair<const_iterator, Key> lower_bound2(const Key& key) const
     {
-        return const_cast<slidable_map*>(this)->upper_bound(key);
+        std::pair<node*, Key> ret = lowerbound2(key, false);
+        return std::pair<const_iterator, Key>(const_iterator(ret.first, this), ret.second);
     }
-
-    iterator rlower_bound(const Key& key)
+    std::pair<iterator, Key> rlower_bound2(const Key& key)
     {
-        node* p = root;
-        node* leftnode = NULL;
-        if (!p) 
-            return iterator(NULL, this);
-        
-        Diff rlkey = key - Key();
-        while(true) {
-            if (p->key < rlkey) {
-                if (!p->right) {
-                    return iterator(p, this);
-                }
-                leftnode = p;
-                rlkey -= p->key;
-                p = p->right;
-            } else if (rlkey < p->key) {
-                if (!p->left) {
-                    //return iterator(previous(p));
-                    return iterator(leftnode, this);
-                }
-                rlkey -= p->key;
-                p = p->left;
-            } else {
-                return iterator(p, this);
-            }
-        }
+        std::pair<node*, Key> ret = rlowerbound2(key, true);
+        return std::pair<iterator, Key>(iterator(ret.first, this), ret.second);
     }
-    const_iterator rlower_bound(const Key& key) const
+    std::pair<const_iterator, Key> rlower_bound2(const Key& key) const
     {
-        return const_cast<slidable_map*>(this)->rlower_bound(key);
+        std::pair<node*, Key> ret = rlowerbound2(key, false);
+        return std::pair<const_iterator, Key>(const_iterator(ret.first, this), ret.second);
     }
-    
-    iterator rupper_bound(const Key& key)
+
+    // writes find(k) for every k in [first, last) to out.
+    // several searches run at once so that their cache misses overlap.
+    template <class InputIt, class OutputIt>
+    OutputIt find_many(InputIt first, InputIt last, OutputIt out)
     {
-        node* p = root;
-        
-        if (!p) {
-            return iterator(NULL, this);
-        }
-        Diff rlkey = key - Key();
-        while(1) {
-            if (p->key < rlkey) {
-                if (!p->right) {
-                    return iterator(p, this);
-                }
-                rlkey -= p->key;
-                p = p->right;
-            } else if (rlkey < p->key) {
-                if (!p->left) {
-                    return iterator(previous(p), this);
-                }
-                rlkey -= p->key;
-                p = p->left;
-            } else {
-                return iterator(previous(p), this);
-            }
-        }
+        node* found[lanes];
+        while (size_type n = searchmany(first, last, false, found))
+            for (size_type i=0; i<n; ++i)
+                *out++ = iterator(found[i], this);
+        return out;
     }
-    const_iterator rupper_bound(const Key& key) const
+    template <class InputIt, class OutputIt>
+    OutputIt find_many(InputIt first, InputIt last, OutputIt out) const
     {
-        return const_cast<slidable_map*>(this)->rupper_bound(key);
+        node* found[lanes];
+        while (size_type n = searchmany(first, last, false, found))
+            for (size_type i=0; i<n; ++i)
+                *out++ = const_iterator(found[i], this);
+        return out;
     }
 
-    std::pair<iterator, Key> lower_bound2(const Key& key)
+    // writes lower_bound(k) for every k in [first, last) to out.
+    template <class InputIt, class OutputIt>
+    OutputIt lower_bound_many(InputIt first, InputIt last, OutputIt out)
     {
-        typedef std::pair<iterator, Key> rettype;
-        node* p = root;
-        if (!p)
-            return rettype(iterator(NULL, this), Key());
-
-        const Key& orgkey = key;
-        Diff rlkey = key - Key();
-        while(1) {
-            if (p->key < rlkey) {
-                rlkey -= p->key;
-                if (!p->right) {
-                    node* old;
-                    do {
-                        old = p;
-                        rlkey += p->key;
-                        p = Parent(p);
-                    } while(p && p->right == old);
-                    return rettype(iterator(p, this), orgkey-rlkey);
-                }
-                p = p->right;
-            } else if (rlkey < p->key) {
-                rlkey -= p->key;
-                if (!p->left) {
-                    return rettype(iterator(p, this), orgkey-rlkey);
-                }
-                p = p->left;
-            } else {
-                return rettype(iterator(p, this), orgkey);
-            }
-        }
+        node* found[lanes];
+        while (size_type n = searchmany(first, last, true, found))
+            for (size_type i=0; i<n; ++i)
+                *out++ = iterator(found[i], this);
+        return out;
     }
-    std::pair<const_iterator, Key> lower_bound2(const Key& key) const
+    template <class InputIt, class OutputIt>
+    OutputIt lower_bound_many(InputIt first, InputIt last, OutputIt out) const
     {
-        std::pair<iterator, Key> ret = const_cast<slidable_map*>(this)->lower_bound2(key);
-        return std::pair<const_iterator, Key>(ret.first, ret.second);
+        node* found[lanes];
+        while (size_type n = searchmany(first, last, true, found))
+            for (size_type i=0; i<n; ++i)
+                *out++ = const_iterator(found[i], this);
+        return out;
     }
-    std::pair<iterator, Key> rlower_bound2(const Key& key)
+    
+    void swap(slidable_map& rhs)
     {
-        typedef std::pair<iterator, Key> rettype;
-        node* p = root;
-        if (!p)
-            return rettype(iterator(NULL, this), Key());
-
-        const Key& orgkey = key;
-        Diff rlkey = key - Key();
-        while(true) {
-            if (p->key < rlkey) {
-                rlkey -= p->key;
-                if (!p->right) {
-                    return rettype(iterator(p, this), orgkey-rlkey);
-                }
-                p = p->right;
-            } else if (rlkey < p->key) {
-                rlkey -= p->key;
-                if (!p->left) {
-                    node* old;
-                    do {
-                        old = p;
-                        rlkey += p->key;
-                        p = Parent(p);
-                    } while(p && p->left == old);
-                    return rettype(iterator(p, this), orgkey-rlkey);
-                }
-                p = p->left;
-            } else {
-                return rettype(iterator(p, this), orgkey);
-            }
-        }
-    }
-
-    std::pair<const_iterator, Key> rlower_bound2(const Key& key) const
-    {
-        std::pair<iterator, Key> ret = const_cast<slidable_map*>(this)->rlower_bound2(key);
-        return std::pair<const_iterator, Key>(ret.first, ret.second);
-    }
-    
-    void swap(slidable_map& rhs)
-    {
-        if (static_cast<NodeAllocator&>(*this) == static_cast<NodeAllocator&>(rhs)) {
-            std::swap(this->root, rhs.root);
-            std::swap(this->rightmost, rhs.rightmost);
-            std::swap(this->leftmost, rhs.leftmost);
-        } else {
-            node *copied_for_rhs,
-                 *copied_for_lhs;
+        forget();
+        rhs.forget();
+        if (static_cast<NodeAllocator&>(*this) == static_cast<NodeAllocator&>(rhs)) {
+            std::swap(this->root, rhs.root);
+            std::swap(this->rightmost, rhs.rightmost);
+            std::swap(this->leftmost, rhs.leftmost);
+        } else {
+            node *copied_for_rhs,
+                 *copied_for_lhs;
 
             copied_for_rhs = rhs.copynodes(NULL, this->root);
             try {
@@ -872,17 +1238,126 @@ public:
     
     std::pair<const_iterator, const_iterator> equal_range(const key_type& key) const
     {
-        std::pair<iterator, iterator> p = const_cast<slidable_map*>(this)->equal_range(key);
-        return std::pair<const_iterator, const_iterator>(p.first, p.second);
+        const_iterator first = find(key);
+        const_iterator last = first;
+        if (first != end())
+            ++last;
+        return std::pair<const_iterator, const_iterator>(first, last);
     }
 
     void movekey(const_iterator where, const Diff& qty)
     {
         assert(where.wp.pnode && where.wp.container == this);
         node* node = where.wp.pnode;
+        if (KeyStorage::narrow)
+            checkkey(getabkey(node) - Key() + qty);
+        forget();
+        pushpath(node);
+        push(node);
         node->key += qty;
         if (node->right) node->right->key -= qty;
         if (node->left) node->left->key -= qty;
+        slid(node);
+    }
+
+    void concat(slidable_map& rhs)
+    {
+        assert(this != &rhs);
+        if (rhs.empty())
+            return;
+        assert(empty() || rbegin()->first() < rhs.begin()->first());
+        forget();
+
+        if (!(static_cast<NodeAllocator&>(*this) == static_cast<NodeAllocator&>(rhs))) {
+            const_iterator p = rhs.begin(), e = rhs.end();
+            Key pk = p->first();
+            size_type n = 0;
+            try {
+                for (; p != e; p = next(p, pk), ++n)
+                    insertnode(pk, p->second());
+            } catch (...) {
+                for (; n > 0; --n)
+                    erasenode(rightmost);
+                throw;
+            }
+            rhs.clear();
+            return;
+        }
+
+        node* m = rhs.leftmost;
+        const Diff mkey = getabkey(m) - Key();
+        rhs.unlinknode(m);
+        m->key = mkey;
+        SetParent(m, NULL);
+
+        node::link(rightmost, m);
+        node::link(m, rhs.leftmost);
+
+        size_type h;
+        root = joinnodes(root, treeheight(root), m, rhs.root, rhs.treeheight(rhs.root), h);
+        leftmost = getleftmost(root);
+        rightmost = getrightmost(root);
+        mysize += rhs.mysize + 1;
+
+        rhs.root = rhs.leftmost = rhs.rightmost = NULL;
+        rhs.mysize = 0;
+    }
+
+    // copies the elements into an immutable map laid out for searching.
+    // frozen_slidable_map.hpp has to be included to use this.
+    frozen_slidable_map<Key, Diff, Type, Alloc> freeze() const
+    {
+        return frozen_slidable_map<Key, Diff, Type, Alloc>(*this);
+    }
+
+    // reallocates every node in key order so that the nodes which are next to each other
+    // in order are allocated one after another. the keys, values and shape are kept.
+    // with separate_values the values stay where they are and only the nodes move.
+    // iterators are invalidated.
+    void compact()
+    {
+        if (!root)
+            return;
+        typedef typename Alloc::template rebind<node*>::other PointerAllocator;
+        std::vector<node*, PointerAllocator> fresh((PointerAllocator(static_cast<const ValueAllocator&>(*this))));
+        fresh.reserve(mysize);
+        try {
+            for (size_type i=0; i<mysize; ++i)
+                fresh.push_back(NodeAllocator::allocate(1));
+        } catch (...) {
+            for (size_type i=0; i<fresh.size(); ++i)
+                NodeAllocator::deallocate(fresh[i], 1);
+            throw;
+        }
+
+        size_type built = 0;
+        node* tmp;
+        try {
+            tmp = relocatenodes(root, &fresh[0], built);
+        } catch (...) {
+            for (size_type i=0; i<fresh.size(); ++i) {
+                if (i < built) {
+                    // separate values still belong to the old nodes
+                    if (ValueLayout::separate)
+                        NodeAllocator::destroy(fresh[i]);
+                    else
+                        destroynode(fresh[i]);
+                }
+                NodeAllocator::deallocate(fresh[i], 1);
+            }
+            throw;
+        }
+        if (Threading::links)
+            node::link(threadnodes(tmp, NULL), NULL);
+
+        if (ValueLayout::separate)
+            dropnodes(root);
+        else
+            recursive_erase(root);
+        forget();
+        root = tmp;
+        leftmost = getleftmost(root);
+        rightmost = getrightmost(root);
     }
     
 private:
@@ -900,25 +1375,159 @@ private:
 
     static node* getleftmost(node* p)
     {
-        if (p)
-            while(p->left) p = p->left;
+        if (p) {
+            push(p);
+            while(p->left) {
+                p = p->left;
+                push(p);
+            }
+        }
         return p;
     }
     static node* getrightmost(node* p)
     {
-        if (p)
-            while(p->right) p = p->right;
+        if (p) {
+            push(p);
+            while(p->right) {
+                p = p->right;
+                push(p);
+            }
+        }
         return p;
     }
 
+    static void push(node* p) { if (Augment::lazy) Augment::push(p); }
+    static void update(node* p) { if (Augment::aggregate) Augment::update(p); }
+
+    // recalculates p and every ancestor of p
+    static void updatepath(node* p)
+    {
+        if (!Augment::aggregate)
+            return;
+        for (; p; p = Parent(p))
+            update(p);
+    }
+
+    iterator iteratorof(node* p) const { return iterator(p, this); }
+
+    // the first node whose key is not less than after and whose gap to the next node in the
+    // subtree of p is at least len. base is the key of the parent of p. the gap after the last
+    // node of the subtree is checked by the ancestor which it is next to.
+    static node* gapnode(node* p, const Diff& base, const Diff& after, const Diff& len)
+    {
+        if (!p)
+            return NULL;
+        push(p);
+        const Diff key = base + p->key;
+        if (key + p->aug.last < after)
+            return NULL;
+        if (!(key + p->aug.first < after) && p->aug.gap < len)
+            return NULL;
+        if (key < after)
+            return gapnode(p->right, key, after, len);
+        if (node* q = gapnode(p->left, key, after, len))
+            return q;
+        if (p->left) {
+            const Diff prev = key + p->left->key + p->left->aug.last;
+            if (!(prev < after) && !(key - prev < len))
+                return getrightmost(p->left);
+        }
+        if (p->right && !(p->right->key + p->right->aug.first < len))
+            return p;
+        return gapnode(p->right, key, after, len);
+    }
+
+    // the first and last keys in a range and the greatest gap between the keys in it
+    struct gap_span {
+        gap_span() : any(false), first(), last(), gap() {}
+        bool any;
+        Diff first;
+        Diff last;
+        Diff gap;
+        void add(const Diff& f, const Diff& l, const Diff& g)
+        {
+            if (any) {
+                if (gap < f - last)
+                    gap = f - last;
+                if (gap < g)
+                    gap = g;
+            } else {
+                any = true;
+                first = f;
+                gap = g;
+            }
+            last = l;
+        }
+    };
+
+    // adds the keys in [lo, hi] of the subtree of p to span in order
+    static void gapspan(node* p, Diff base, const Diff& lo, const Diff& hi, gap_span& span)
+    {
+        while (p) {
+            push(p);
+            const Diff key = base + p->key;
+            const Diff first = key + p->aug.first, last = key + p->aug.last;
+            if (last < lo || hi < first)
+                return;
+            if (!(first < lo) && !(hi < last)) {
+                span.add(first, last, p->aug.gap);
+                return;
+            }
+            gapspan(p->left, key, lo, hi, span);
+            if (!(key < lo) && !(hi < key))
+                span.add(key, key, Diff());
+            // the right subtree is visited by the loop
+            base = key;
+            p = p->right;
+        }
+    }
+
+    // recalculates the nodes on the path of a slide which ended at p
+    static void slid(node* p)
+    {
+        if (Augment::keyed)
+            updatepath(p);
+    }
+
+    // recalculates every node of the subtree of p after the values were changed
+    static void updatesubtree(node* p)
+    {
+        if (!Augment::aggregate || !p)
+            return;
+        updatesubtree(p->left);
+        updatesubtree(p->right);
+        update(p);
+    }
+
+    // brings every ancestor of p up to date
+    static void pushpath(node* p)
+    {
+        if (!Augment::lazy)
+            return;
+        detail::stack_pod_vector<node*, 64*2> path;
+        for (node* q = Parent(p); q; q = Parent(q))
+            path.push_back(q);
+        while (!path.empty()) {
+            push(path.back());
+            path.pop_back();
+        }
+    }
+
     static inline node* previous(node* base)
     {
         assert(base);
+        if (Threading::links)
+            return node::pred(base);
 
         node* p;
+        push(base);
         if (base->left) {
             p = base->left;
-            while (p->right) p = p->right;
+            push(p);
+            while (p->right) {
+                p = p->right;
+                push(p);
+            }
         } else {
             node* old = base;
             p = Parent(base);
@@ -933,11 +1542,18 @@ private:
     static inline node* next(node* base)
     {
         assert (base);
+        if (Threading::links)
+            return node::succ(base);
 
         node* p;
+        push(base);
         if (base->right) {
             p = base->right;
-            while (p->left) p = p->left;
+            push(p);
+            while (p->left) {
+                p = p->left;
+                push(p);
+            }
         } else {
             node* old = base;
             p = Parent(base);
@@ -953,11 +1569,14 @@ private:
         assert (base);
 
         node* p;
+        push(base);
         if (base->right) {
             p = base->right;
+            push(p);
             nextkey += p->key;
             while (p->left) {
                 p = p->left;
+                push(p);
                 nextkey += p->key;
             }
         } else {
@@ -977,8 +1596,9 @@ private:
         return iterator(next(base.wp.pnode, nextkey), base.wp.container);
     }
 
-    static inline Key getabkey(const node* base)
+    static inline Key getabkey(node* base)
     {
+        pushpath(base);
         Key ret = Key();
         do {
             ret += base->key;
@@ -1001,8 +1621,7 @@ private:
             if (p->right)
                 childstack.push_back(p->right);
 
-            NodeAllocator::destroy(p);
-            NodeAllocator::deallocate(p, 1);
+            deletenode(p);
 
             if (leftchild) {    
                 p = leftchild;
@@ -1020,18 +1639,14 @@ private:
         if (!org)
             return NULL;
         detail::stack_pod_vector<std::pair<const node*,node*>, 64*2> child;
-        node* const top = NodeAllocator::allocate(1);
-        node* p = top;
+        node* top = NULL;
         try {
             while(true) {
-                try {
-                    new ((void*)p) node (*org);
-                    p->left = p->right = NULL;
-                } catch (...) {
-                    NodeAllocator::deallocate(p, 1);
-                    throw;
-                }
-    
+                node* p = newnode(NULL, NULL, org->col, org->key, org->value());
+                p->aug = org->aug;
+                if (!top)
+                    top = p;
+
                 if (Parent(org)) {
                     if (ISLEFT(org))
                         link2left(parent, p);
@@ -1053,16 +1668,73 @@ private:
                     parent = child.back().second;
                     child.pop_back();
                 }
-                p = NodeAllocator::allocate(1);
             }
         } catch (...) {
             recursive_erase(top);
             throw;
         }
 
+        if (Threading::links)
+            node::link(threadnodes(top, NULL), NULL);
         return top;
     }
 
+    // builds a copy of the subtree of org in fresh[built], fresh[built+1], ... in order.
+    // the values are moved if that can not throw, and separate values are shared with org.
+    node* relocatenodes(node* org, node* const* fresh, size_type& built)
+    {
+        if (!org)
+            return NULL;
+        node* l = relocatenodes(org->left, fresh, built);
+        node* p = fresh[built];
+        relocatevalue(p, l, org, org->storage);
+        ++built;
+        p->aug = org->aug;
+        if (l)
+            SetParent(l, p);
+        p->right = relocatenodes(org->right, fresh, built);
+        if (p->right)
+            SetParent(p->right, p);
+        return p;
+    }
+
+    template <class V>
+    void relocatevalue(node* p, node* left, node* org, detail::value_slot<V, false>&)
+    {
+#ifndef BOOST_NO_RVALUE_REFERENCES
+        constructnode(p, NULL, left, org->col, org->key, std::move_if_noexcept(org->value()));
+#else
+        constructnode(p, NULL, left, org->col, org->key, org->value());
+#endif
+    }
+    // takes over the pointer, so it neither allocates nor throws
+    template <class V>
+    void relocatevalue(node* p, node* left, node* org, detail::value_slot<V, true>& slot)
+    {
+        new ((void*)p) node(NULL, left, NULL, org->col, org->key, slot.pval);
+    }
+
+    // frees the nodes of the subtree of p but not their values, which were handed to other nodes
+    void dropnodes(node* p)
+    {
+        if (!p)
+            return;
+        dropnodes(p->left);
+        dropnodes(p->right);
+        NodeAllocator::destroy(p);
+        NodeAllocator::deallocate(p, 1);
+    }
+
+    // links the nodes of the subtree of p in order after prev, and returns the last one.
+    static node* threadnodes(node* p, node* prev)
+    {
+        if (!p)
+            return prev;
+        prev = threadnodes(p->left, prev);
+        node::link(prev, p);
+        return threadnodes(p->right, p);
+    }
+
     void swaplink_with_rightchild(node* p)
     {
         node* rc = p->right;
@@ -1173,13 +1845,16 @@ private:
     {
         assert(p);
 
+        push(p);
         if (p->left) {
             if (p->right) {
                 node* descendant = p->right;
+                push(descendant);
                 Diff diff = descendant->key;
                 
                 while(descendant->left) {
                     descendant = descendant->left;
+                    push(descendant);
                     diff += descendant->key;
                 }
                              
@@ -1199,9 +1874,10 @@ private:
                 }
                 descendant->left->key -= diff;
                 
+                // with avl_balance the colors written here are heights fixed up by avl_retrace()
                 if (node* bottom = p->right) {
-                    assert(ISBLACK(descendant));
-                    assert(ISRED(bottom));
+                    assert(Balance::avl || ISBLACK(descendant));
+                    assert(Balance::avl || ISRED(bottom));
                     descendant->col = p->col;
                     // descendant > bottom > p
                     swaplink_with_right_single_child(p);
@@ -1216,8 +1892,8 @@ private:
                     std::swap(descendant->col, p->col);
                 }
             } else {        //p is black and child is red
-                assert(ISBLACK(p));
-                assert(ISRED(p->left));
+                assert(Balance::avl || ISBLACK(p));
+                assert(Balance::avl || ISRED(p->left));
                 node* child = p->left;
                 swaplink_with_left_single_child(p);
                 child->col = Black;
@@ -1227,8 +1903,8 @@ private:
             }
         } else {
             if (p->right) { //p is black and child is red
-                assert(ISBLACK(p));
-                assert(ISRED(p->right));
+                assert(Balance::avl || ISBLACK(p));
+                assert(Balance::avl || ISRED(p->right));
                 node* child = p->right;
                 swaplink_with_right_single_child(p);
 
@@ -1252,6 +1928,7 @@ private:
             const bool bleft = (enode == eparent->left);
             sibling = bleft ? eparent->right : eparent->left;
             assert(sibling);
+            push(sibling);
             if (ISRED(sibling)) {
                 eparent->col = Red;
                 sibling->col = Black;
@@ -1303,7 +1980,8 @@ private:
         }
     }
     
-    void insert_balance(node* rednode)
+    // returns true if the black height of the whole tree was increased
+    bool insert_balance(node* rednode)
     {
         node* rp = Parent(rednode);
         node* grandparent = Parent(rp);
@@ -1347,10 +2025,61 @@ private:
                         grandparent = Parent(rp);
                         continue;
                     }
+                } else {
+                    return true;
                 }
             }
             break;
         }
+        return false;
+    }
+
+    static size_type avlheight(const node* p) { return p ? p->col : 0; }
+    static void setavlheight(node* p)
+    {
+        p->col = static_cast<typename node::color>(1 + (std::max)(avlheight(p->left), avlheight(p->right)));
+    }
+
+    // sets the height of p from its children, rotating p if they differ by two.
+    // returns the node which has taken the place of p.
+    node* avl_fix(node* p)
+    {
+        const size_type hl = avlheight(p->left);
+        const size_type hr = avlheight(p->right);
+        if (hr + 1 < hl) {
+            node* l = p->left;
+            if (avlheight(l->left) < avlheight(l->right)) {
+                rotate_left(l);
+                setavlheight(l);
+                setavlheight(p->left);
+            }
+            p = rotate_right(p);
+            setavlheight(p->right);
+        } else if (hl + 1 < hr) {
+            node* r = p->right;
+            if (avlheight(r->right) < avlheight(r->left)) {
+                rotate_right(r);
+                setavlheight(r);
+                setavlheight(p->right);
+            }
+            p = rotate_left(p);
+            setavlheight(p->left);
+        }
+        setavlheight(p);
+        return p;
+    }
+
+    // fixes the heights from p to the root. with stop it ends at the first subtree whose height
+    // has not changed, which is enough when one subtree below p has grown by one.
+    void avl_retrace(node* p, bool stop)
+    {
+        while (p) {
+            const size_type h = p->col;
+            p = avl_fix(p);
+            if (stop && p->col == h)
+                return;
+            p = Parent(p);
+        }
     }
         
     void link2left(node* target, node* left)
@@ -1382,8 +2111,10 @@ private:
     node* rotate_left(node* base)
     {
         assert(base);
+        push(base);
         node *ntmp = base->right;
         assert(ntmp);
+        push(ntmp);
         
         node* bp = Parent(base);
         if (bp) {
@@ -1409,14 +2140,18 @@ private:
             ntmp->key += base->key;
             base->key = -tmpkey;
         }
+        update(base);
+        update(ntmp);
         return ntmp;
     }
 
     node* rotate_right(node* base)
     {
         assert(base);
+        push(base);
         node *ntmp = base->left;
         assert(ntmp);
+        push(ntmp);
         node* bp = Parent(base);
         if (bp) {
             if (ISLEFT(base))
@@ -1441,7 +2176,8 @@ private:
             ntmp->key += base->key;
             base->key = -tmpkey;
         }
-        
+        update(base);
+        update(ntmp);
         return ntmp;
     }
 
@@ -1451,6 +2187,7 @@ private:
         Diff diff = key;
         assert(p);
         while(true) {
+            push(p);
             if (p->key < diff) {
                 diff -= p->key;
                 if (!p->right)
@@ -1480,26 +2217,26 @@ private:
     std::pair<node*,bool> insertnode(const Key& key, const Type& value)
 #endif
     {
+        if (KeyStorage::narrow)
+            checkkey(key - Key());
         if (!root) {
-            node* tmp = NodeAllocator::allocate(1);
-            try {
 #ifndef BOOST_NO_RVALUE_REFERENCES
-                new ((void*)tmp) node(NULL, NULL, NULL, Black, key-Key(), std::forward<T>(value));
+            node* tmp = newnode(NULL, NULL, Balance::avl ? Leaf : Black, key-Key(), std::forward<T>(value));
 #else
-                new ((void*)tmp) node(NULL, NULL, NULL, Black, key-Key(), value);
+            node* tmp = newnode(NULL, NULL, Balance::avl ? Leaf : Black, key-Key(), value);
 #endif
-            } catch (...) {
-                NodeAllocator::deallocate(tmp, 1);
-                throw;
-            }
             root = leftmost = rightmost = tmp;            
+            update(tmp);
             ++mysize;
             return std::make_pair(root, true);
         } else {
-            Diff pos;
-            std::pair<node*,bool> ret = getinsertnode(key-Key(), root, pos);
-            if (!ret.second) 
+            Diff pos, rlkey;
+            node* start = searchstart(key, rlkey);
+            std::pair<node*,bool> ret = getinsertnode(rlkey, start, pos);
+            if (!ret.second) {
+                setfinger(ret.first, key, ret.first->key);
                 return ret;
+            }
 
             node* child = insert_direct(ret.first, pos, 
 #ifndef BOOST_NO_RVALUE_REFERENCES
@@ -1508,10 +2245,40 @@ private:
                 value);
 #endif
 
+            setfinger(child, key, child->key);
             return std::make_pair(child, true);
         }
     }
     
+#ifndef BOOST_NO_RVALUE_REFERENCES
+    template <class T>
+    std::pair<node*,bool> appendnode(const Key& key, T&& value)
+#else
+    std::pair<node*,bool> appendnode(const Key& key, const Type& value)
+#endif
+    {
+        if (!root || !(lastkey() < key)) {
+#ifndef BOOST_NO_RVALUE_REFERENCES
+            return insertnode(key, std::forward<T>(value));
+#else
+            return insertnode(key, value);
+#endif
+        }
+        if (KeyStorage::narrow)
+            checkkey(key - Key());
+        pushpath(rightmost);
+        push(rightmost);
+        node* child = insert_direct(rightmost, key - tailkey,
+#ifndef BOOST_NO_RVALUE_REFERENCES
+            std::forward<T>(value));
+#else
+            value);
+#endif
+        tail = child;
+        tailkey = key;
+        return std::make_pair(child, true);
+    }
+
 #ifndef BOOST_NO_RVALUE_REFERENCES
     template <class T>
     node* insert_direct(node* parent, const Diff& pos, T&& value)
@@ -1520,43 +2287,104 @@ private:
 #endif
     {
         assert(parent);
-        node* child = NodeAllocator::allocate(1);
-        try {
 #ifndef BOOST_NO_RVALUE_REFERENCES
-            new ((void*)child) node(parent, NULL, NULL, Red, pos, std::forward<T>(value));
+        node* child = newnode(parent, NULL, Balance::avl ? Leaf : Red, pos, std::forward<T>(value));
 #else
-            new ((void*)child) node(parent, NULL, NULL, Red, pos, value);
+        node* child = newnode(parent, NULL, Balance::avl ? Leaf : Red, pos, value);
 #endif
-        } catch (...) {
-            NodeAllocator::deallocate(child, 1);
-            throw;
-        }
-        
+
         if (Diff() < pos) {
             assert(ISNIL(parent->right));
+            node::link(child, node::succ(parent));
+            node::link(parent, child);
             parent->right = child;
             if (parent == rightmost)
                 rightmost = child;
         } else {
             assert(ISNIL(parent->left));
+            node::link(node::pred(parent), child);
+            node::link(child, parent);
             parent->left = child;
             if (parent == leftmost)
                 leftmost = child;
         }
+        updatepath(child);
        
-        if (ISRED(parent)) {
+        if (Balance::avl) {
+            avl_retrace(parent, true);
+        } else if (ISRED(parent)) {
             insert_balance(child);
         }
-        assert(ISBLACK(root));
+        assert(Balance::avl || ISBLACK(root));
 
         ++mysize;
         return child;
     }
 
     void erasenode(node* target)
+    {
+        unlinknode(target);
+        deletenode(target);
+    }
+
+#ifndef BOOST_NO_RVALUE_REFERENCES
+    template <class V>
+    void constructnode(node* p, node* parent, node* left, typename node::color c, const Diff& key, V&& value)
+#else
+    void constructnode(node* p, node* parent, node* left, typename node::color c, const Diff& key, const Type& value)
+#endif
+    {
+        TypeAllocator a(static_cast<const ValueAllocator&>(*this));
+#ifndef BOOST_NO_RVALUE_REFERENCES
+        new ((void*)p) node(parent, left, NULL, c, key, node::slot::make(a, std::forward<V>(value)));
+#else
+        new ((void*)p) node(parent, left, NULL, c, key, node::slot::make(a, value));
+#endif
+    }
+
+#ifndef BOOST_NO_RVALUE_REFERENCES
+    template <class V>
+    node* newnode(node* parent, node* left, typename node::color c, const Diff& key, V&& value)
+#else
+    node* newnode(node* parent, node* left, typename node::color c, const Diff& key, const Type& value)
+#endif
+    {
+        node* p = NodeAllocator::allocate(1);
+        try {
+#ifndef BOOST_NO_RVALUE_REFERENCES
+            constructnode(p, parent, left, c, key, std::forward<V>(value));
+#else
+            constructnode(p, parent, left, c, key, value);
+#endif
+        } catch (...) {
+            NodeAllocator::deallocate(p, 1);
+            throw;
+        }
+        return p;
+    }
+
+    void destroynode(node* p)
+    {
+        TypeAllocator a(static_cast<const ValueAllocator&>(*this));
+        p->storage.release(a);
+        NodeAllocator::destroy(p);
+    }
+
+    void deletenode(node* p)
+    {
+        destroynode(p);
+        NodeAllocator::deallocate(p, 1);
+    }
+
+    // detaches target from the tree without destroying it
+    void unlinknode(node* target)
     {
         assert(target);
         assert(mysize > 0);
+        forget();
+        node::link(node::pred(target), node::succ(target));
+        pushpath(target);
+        push(target);
         if (mysize == 1) {
             assert(target == root);
             assert(target == leftmost);
@@ -1571,7 +2399,7 @@ private:
                 rightmost = (target->left) ? target->left : target->parent;
             }
             swap2endleaf(target);
-            if (ISBLACK(target)) {
+            if (!Balance::avl && ISBLACK(target)) {
                 erase_balance(target);
             }   
         
@@ -1581,43 +2409,781 @@ private:
             } else {
                 tp->right = NULL;
             }
+            updatepath(tp);
+            if (Balance::avl)
+                avl_retrace(tp, false);
             assert(!next(rightmost));
             assert(!previous(leftmost));
         }
-        NodeAllocator::destroy(target);
-        NodeAllocator::deallocate(target, 1);
         --mysize;
 
-        assert(SAFE_ISBLACK(root));
+        assert(Balance::avl || SAFE_ISBLACK(root));
     }
 
-    inline node* findnode(const Key& key) const
+    // the height joinnodes() and splitnodes() balance by
+    size_type treeheight(const node* p) const
     {
-        node* p = root;
-        Diff rlkey = key - Key();
-        while(p) {
-            if (p->key < rlkey) {
-                rlkey -= p->key;
-                p = p->right;
-            } else if (rlkey < p->key) {
-                rlkey -= p->key;
-                p = p->left;
-            } else {
-                return p;
-            }
+        return Balance::avl ? avlheight(p) : blackheight(p);
+    }
+
+    size_type blackheight(const node* p) const
+    {
+        size_type h = 0;
+        for (; p; p = p->left) {
+            if (ISBLACK(p))
+                ++h;
         }
-        return NULL;
+        return h;
     }
 
-public:
-    bool check_structure() const
+    // l, m and r are detached subtrees whose top node has absolute key (relative to Key()).
+    // all keys of l < key of m < all keys of r.
+    // rotations go through 'root', so it is overwritten with the joined tree.
+    // with avl_balance the heights are those of treeheight(), and l and r are joined under m
+    // if they differ by one at most.
+    node* joinnodes(node* l, size_type hl, node* m, node* r, size_type hr, size_type& h)
     {
-        if (mysize == 0) {
-            return (root == NULL && leftmost == NULL && rightmost == NULL);
+        assert(m);
+        if (!Balance::avl && l && ISRED(l)) {
+            l->col = Black;
+            ++hl;
+        }
+        if (!Balance::avl && r && ISRED(r)) {
+            r->col = Black;
+            ++hr;
+        }
+        const Diff mkey = m->key;
+        m->left = m->right = NULL;
+
+        if (Balance::avl ? (hl <= hr + 1 && hr <= hl + 1) : hl == hr) {
+            SetParent(m, NULL);
+            m->col = Black;
+            if (l) {
+                l->key -= mkey;
+                link2left(m, l);
+            }
+            if (r) {
+                r->key -= mkey;
+                link2right(m, r);
+            }
+            if (Balance::avl)
+                setavlheight(m);
+            update(m);
+            h = Balance::avl ? m->col : hl + 1;
+            root = m;
+            return m;
+        }
+
+        node* p = NULL;
+        Diff pkey = Diff();
+        m->col = Red;
+        if (hr < hl) {
+            //descend right spine of l until black height equals r
+            node* c = l;
+            Diff ckey = l->key;
+            size_type ch = hl;
+            while (c && (Balance::avl ? hr + 1 < avlheight(c) : (ISRED(c) || hr < ch))) {
+                push(c);
+                if (ISBLACK(c))
+                    --ch;
+                p = c;
+                pkey = ckey;
+                c = c->right;
+                if (c)
+                    ckey += c->key;
+            }
+            root = l;
+            m->key = mkey - pkey;
+            link2right(p, m);
+            if (c) {
+                c->key = ckey - mkey;
+                link2left(m, c);
+            }
+            if (r) {
+                r->key -= mkey;
+                link2right(m, r);
+            }
+            h = hl;
         } else {
-            if (root == NULL)
-                return false;
-            if (root->parent)
+            //descend left spine of r until black height equals l
+            node* c = r;
+            Diff ckey = r->key;
+            size_type ch = hr;
+            while (c && (Balance::avl ? hl + 1 < avlheight(c) : (ISRED(c) || hl < ch))) {
+                push(c);
+                if (ISBLACK(c))
+                    --ch;
+                p = c;
+                pkey = ckey;
+                c = c->left;
+                if (c)
+                    ckey += c->key;
+            }
+            root = r;
+            m->key = mkey - pkey;
+            link2left(p, m);
+            if (c) {
+                c->key = ckey - mkey;
+                link2right(m, c);
+            }
+            if (l) {
+                l->key -= mkey;
+                link2left(m, l);
+            }
+            h = hr;
+        }
+        if (Balance::avl) {
+            setavlheight(m);
+            updatepath(m);
+            avl_retrace(p, true);
+            h = root->col;
+            return root;
+        }
+        updatepath(m);
+        if (ISRED(p) && insert_balance(m))
+            ++h;
+        return root;
+    }
+
+    // splits detached subtree t whose black height is ht into l (< key) and r (>= key)
+    void splitnodes(node* t, size_type ht, const Diff& key, node*& l, size_type& hl, node*& r, size_type& hr)
+    {
+        if (!t) {
+            l = r = NULL;
+            hl = hr = 0;
+            return;
+        }
+        push(t);
+        node* tl = t->left;
+        node* tr = t->right;
+        const size_type hc = ISBLACK(t) ? ht - 1 : ht;
+        const size_type hcl = Balance::avl ? avlheight(tl) : hc;
+        const size_type hcr = Balance::avl ? avlheight(tr) : hc;
+        if (tl) {
+            tl->key += t->key;
+            SetParent(tl, NULL);
+        }
+        if (tr) {
+            tr->key += t->key;
+            SetParent(tr, NULL);
+        }
+        node* mid;
+        size_type hmid;
+        if (t->key < key) {
+            splitnodes(tr, hcr, key, mid, hmid, r, hr);
+            l = joinnodes(tl, hcl, t, mid, hmid, hl);
+        } else {
+            splitnodes(tl, hcl, key, l, hl, mid, hmid);
+            r = joinnodes(mid, hmid, t, tr, hcr, hr);
+        }
+    }
+
+    // replaces all elements with n elements from first whose keys are 0,1,2,...n-1.
+    // the tree is built balanced in O(n).
+    template <class InputIt>
+    void assign_sequence(InputIt first, size_type n)
+    {
+        if (KeyStorage::narrow && n)
+            checkkey(Diff(n - 1));
+        settree(buildnodes(first, n, 0, reddepthof(n), Diff(), Diff()), n);
+    }
+
+    // replaces all elements with n elements from first, which are in key order and have
+    // first() and second() like the iterators. the tree is built balanced in O(n).
+    template <class InputIt>
+    void assign_sorted(InputIt first, size_type n)
+    {
+        settree(buildsorted(first, n, 0, reddepthof(n)), n);
+    }
+
+    // the depth whose nodes are red in a balanced tree of n nodes
+    static size_type reddepthof(size_type n)
+    {
+        size_type reddepth = 0;
+        while ((size_type(2) << reddepth) - 1 <= n)
+            ++reddepth;
+        return reddepth;
+    }
+
+    void settree(node* tmp, size_type n)
+    {
+        recursive_erase(root);
+        forget();
+        root = tmp;
+        leftmost = getleftmost(root);
+        rightmost = getrightmost(root);
+        mysize = n;
+        if (Threading::links)
+            node::link(threadnodes(root, NULL), NULL);
+    }
+
+    // nodes on reddepth are red so that every path has the same number of black nodes.
+    // with avl_balance the heights are set instead, which the halving keeps within one.
+    template <class InputIt>
+    node* buildnodes(InputIt& first, size_type n, size_type depth, size_type reddepth, const Diff& lo, const Diff& parentkey)
+    {
+        if (!n)
+            return NULL;
+        const size_type nl = (n - 1) / 2;
+        const Diff mkey = lo + Diff(nl);
+        node* l = buildnodes(first, nl, depth + 1, reddepth, lo, mkey);
+        node* m;
+        try {
+            m = newnode(NULL, l, (depth == reddepth) ? Red : Black, mkey - parentkey, *first);
+        } catch (...) {
+            recursive_erase(l);
+            throw;
+        }
+        ++first;
+        if (l)
+            SetParent(l, m);
+        try {
+            m->right = buildnodes(first, n - nl - 1, depth + 1, reddepth, mkey + Diff(1), mkey);
+        } catch (...) {
+            recursive_erase(m);
+            throw;
+        }
+        if (m->right)
+            SetParent(m->right, m);
+        if (Balance::avl)
+            setavlheight(m);
+        update(m);
+        return m;
+    }
+
+    // same as buildnodes but the keys are taken from the elements. the returned top node has
+    // its absolute key, which is made relative when its parent is built.
+    template <class InputIt>
+    node* buildsorted(InputIt& first, size_type n, size_type depth, size_type reddepth)
+    {
+        if (!n)
+            return NULL;
+        const size_type nl = (n - 1) / 2;
+        node* l = buildsorted(first, nl, depth + 1, reddepth);
+        node* m;
+        try {
+            if (KeyStorage::narrow)
+                checkkey(first->first() - Key());
+            m = newnode(NULL, l, (depth == reddepth) ? Red : Black, first->first() - Key(), first->second());
+        } catch (...) {
+            recursive_erase(l);
+            throw;
+        }
+        ++first;
+        if (l) {
+            SetParent(l, m);
+            l->key -= m->key;
+        }
+        try {
+            m->right = buildsorted(first, n - nl - 1, depth + 1, reddepth);
+        } catch (...) {
+            recursive_erase(m);
+            throw;
+        }
+        if (m->right) {
+            SetParent(m->right, m);
+            m->right->key -= m->key;
+        }
+        if (Balance::avl)
+            setavlheight(m);
+        update(m);
+        return m;
+    }
+
+    // throws if KeyStorage cannot hold the key k (relative to Key())
+    static void checkkey(const Diff& k)
+    {
+        if (!KeyStorage::fits(k))
+            throw std::overflow_error("slidable_map: key out of the range of KeyStorage");
+    }
+
+    // checks the first and the last keys after a slide. the keys between them follow
+    // since slides keep the order.
+    void checkslide(const Diff& rlbgn, const Diff& qty, bool rightkeys) const
+    {
+        if (!root)
+            return;
+        Diff lo = getabkey(leftmost) - Key();
+        Diff hi = getabkey(rightmost) - Key();
+        if (rightkeys ? !(lo < rlbgn) : !(rlbgn < lo))
+            lo += qty;
+        if (rightkeys ? !(hi < rlbgn) : !(rlbgn < hi))
+            hi += qty;
+        checkkey(lo);
+        checkkey(hi);
+    }
+
+    template <class Factor>
+    void checkscale(const Diff& lo, const Diff* hi, const Factor& factor) const
+    {
+        if (!root)
+            return;
+        checkkey(scaledkey(getabkey(leftmost) - Key(), lo, hi, factor));
+        checkkey(scaledkey(getabkey(rightmost) - Key(), lo, hi, factor));
+    }
+
+    // the key k of scale_range() after scaling
+    template <class Factor>
+    static Diff scaledkey(const Diff& k, const Diff& lo, const Diff* hi, const Factor& factor)
+    {
+        if (k < lo)
+            return k;
+        if (!hi || k < *hi)
+            return lo + static_cast<Diff>((k - lo) * factor);
+        return lo + static_cast<Diff>((*hi - lo) * factor) + (k - *hi);
+    }
+
+    // scales the subtree of p whose keys are in (low, high). base and newbase are the keys
+    // of the parent before and after scaling. a subtree that lies in one of the three ranges of
+    // scaledkey() is done with its root since the keys of the children are relative.
+    template <class Factor>
+    void scalenodes(node* p, const Diff& base, const Diff& newbase, const Diff* low, const Diff* high,
+                    const Diff& lo, const Diff* hi, const Factor& factor)
+    {
+        if (!p)
+            return;
+        const Diff k = base + p->key;
+        const Diff nk = scaledkey(k, lo, hi, factor);
+        p->key = nk - newbase;
+        if (high && !(lo < *high))
+            return;
+        if (hi && low && !(*low < *hi))
+            return;
+        if (low && !(*low < lo) && (!hi || (high && !(*hi < *high)))) {
+            Augment::scale(p, factor);
+            return;
+        }
+        push(p);
+        scalenodes(p->left, k, nk, low, &k, lo, hi, factor);
+        scalenodes(p->right, k, nk, &k, high, lo, hi, factor);
+    }
+
+    // applies f to the values of the subtree of p whose keys are in (low, high) and in [lo, hi).
+    // a subtree that lies in [lo, hi) is done with its root.
+    template <class Update>
+    void updatenodes(node* p, const Diff& base, const Diff* low, const Diff* high,
+                     const Diff& lo, const Diff& hi, const Update& f)
+    {
+        if (!p)
+            return;
+        if (high && !(lo < *high))
+            return;
+        if (low && !(*low < hi))
+            return;
+        if (low && !(*low < lo) && high && !(hi < *high)) {
+            Augment::apply(p, f);
+            return;
+        }
+        push(p);
+        const Diff k = base + p->key;
+        if (!(k < lo) && k < hi)
+            f(p->value());
+        updatenodes(p->left, k, low, &k, lo, hi, f);
+        updatenodes(p->right, k, &k, high, lo, hi, f);
+    }
+
+    // recalculates the nodes whose keys are in [lo, hi) and their ancestors after their values
+    // were changed in place. O(k + logN) for k nodes in the range.
+    void updatekeys(const Key& lo, const Key& hi)
+    {
+        if (Augment::aggregate)
+            updatekeys(root, Diff(), NULL, NULL, lo - Key(), hi - Key());
+    }
+    // base is the key of the parent of p, and the keys of the subtree of p are in (*low, *high)
+    void updatekeys(node* p, const Diff& base, const Diff* low, const Diff* high, const Diff& lo, const Diff& hi)
+    {
+        if (!p)
+            return;
+        if (high && !(lo < *high))
+            return;
+        if (low && !(*low < hi))
+            return;
+        if (low && !(*low < lo) && high && !(hi < *high)) {
+            updatesubtree(p);
+            return;
+        }
+        push(p);
+        const Diff k = base + p->key;
+        updatekeys(p->left, k, low, &k, lo, hi);
+        updatekeys(p->right, k, &k, high, lo, hi);
+        update(p);
+    }
+
+    // reflects every key k to total-k. Augment has to provide reverse()
+    void reflect(const Diff& total)
+    {
+        BOOST_STATIC_ASSERT(!Threading::links);
+        forget();
+        if (!root)
+            return;
+        root->key = total - root->key;
+        Augment::reverse(root);
+        leftmost = getleftmost(root);
+        rightmost = getrightmost(root);
+    }
+
+    // moves all elements whose key is not less than bgn to empty 'right'.
+    // the caller has to know the number of elements moved.
+    void split_at(const Key& bgn, slidable_map& right, size_type rightsize)
+    {
+        assert(right.empty());
+        assert(rightsize <= mysize);
+        assert(static_cast<NodeAllocator&>(*this) == static_cast<NodeAllocator&>(right));
+        forget();
+        right.forget();
+        if (!root)
+            return;
+
+        node *l, *r;
+        size_type hl, hr;
+        splitnodes(root, treeheight(root), bgn - Key(), l, hl, r, hr);
+        if (!Balance::avl) {
+            if (l) l->col = Black;
+            if (r) r->col = Black;
+        }
+
+        root = l;
+        leftmost = getleftmost(l);
+        rightmost = getrightmost(l);
+        mysize -= rightsize;
+
+        right.root = r;
+        right.leftmost = getleftmost(r);
+        right.rightmost = getrightmost(r);
+        right.mysize = rightsize;
+        node::link(rightmost, NULL);
+        node::link(NULL, right.leftmost);
+        assert((root == NULL) == (mysize == 0));
+        assert((right.root == NULL) == (right.mysize == 0));
+    }
+
+    enum { lanes = 8 };
+
+    // searches up to 'lanes' keys from first at once, one level of every search in a round,
+    // and prefetches the next nodes. found[i] is the node of the key or NULL, or the lower bound
+    // if bound is true. returns the number of keys taken.
+    template <class InputIt>
+    size_type searchmany(InputIt& first, InputIt last, bool bound, node** found) const
+    {
+        node* p[lanes];
+        Diff rlkey[lanes];
+        size_type n = 0;
+        for (; n < lanes && first != last; ++n, ++first) {
+            p[n] = root;
+            rlkey[n] = Key(*first) - Key();
+            found[n] = NULL;
+        }
+
+        size_type active = root ? n : 0;
+        while (active) {
+            active = 0;
+            for (size_type i=0; i<n; ++i) {
+                node* q = p[i];
+                if (!q)
+                    continue;
+                push(q);
+                if (q->key < rlkey[i]) {
+                    rlkey[i] -= q->key;
+                    q = q->right;
+                } else if (rlkey[i] < q->key) {
+                    if (bound)
+                        found[i] = q;
+                    rlkey[i] -= q->key;
+                    q = q->left;
+                } else {
+                    found[i] = q;
+                    q = NULL;
+                }
+                if (q) {
+                    detail::prefetch(q);
+                    ++active;
+                }
+                p[i] = q;
+            }
+        }
+        return n;
+    }
+
+    // returns the node a search for key starts from, and sets rlkey to key relative to its parent.
+    // with finger_search the search starts from the lowest ancestor of the finger whose subtree
+    // holds every key between the finger and key.
+    node* searchstart(const Key& key, Diff& rlkey) const
+    {
+        rlkey = key - Key();
+        if (!Search::finger || !finger)
+            return root;
+
+        node* c = finger;
+        Key ck = fingerkey;
+        if (!(key < ck) && !(ck < key)) {
+            rlkey = key - (ck - c->key);
+            return c;
+        }
+        const bool right = ck < key;
+        for (node* p = Parent(c); p; c = p, p = Parent(p)) {
+            const Key pk = ck - c->key;
+            if (right ? (c == p->left && key < pk) : (c == p->right && pk < key)) {
+                rlkey = key - (pk - p->key);
+                return p;
+            }
+            ck = pk;
+        }
+        return root;
+    }
+
+    // drops the nodes remembered with their absolute keys. called whenever keys may change
+    // or nodes may be removed; inserts and rotations keep them.
+    void forget() const
+    {
+        finger = NULL;
+        tail = NULL;
+    }
+
+    // the absolute key of rightmost
+    Key lastkey() const
+    {
+        if (tail != rightmost) {
+            tail = rightmost;
+            tailkey = getabkey(rightmost);
+        }
+        return tailkey;
+    }
+
+    // remembers p as the finger. rlkey is key relative to the parent of p.
+    void setfinger(node* p, const Key& key, const Diff& rlkey) const
+    {
+        if (!Search::finger)
+            return;
+        finger = p;
+        fingerkey = key - rlkey;
+        fingerkey += p->key;
+    }
+
+    // the searches remember the finger only if remember is true, that is, when they are
+    // called from non-const members. const members only read it.
+    inline node* findnode(const Key& key, bool remember) const
+    {
+        Diff rlkey;
+        node* p = searchstart(key, rlkey);
+        while(p) {
+            push(p);
+            if (remember)
+                setfinger(p, key, rlkey);
+            if (p->key < rlkey) {
+                rlkey -= p->key;
+                p = p->right;
+            } else if (rlkey < p->key) {
+                rlkey -= p->key;
+                p = p->left;
+            } else {
+                return p;
+            }
+        }
+        return NULL;
+    }
+
+    node* lowerbound(const Key& key, bool remember) const
+    {
+        Diff rlkey;
+        node* p = searchstart(key, rlkey);
+        if (!p)
+            return NULL;
+
+        while(1) {
+            push(p);
+            if (remember)
+                setfinger(p, key, rlkey);
+            if (p->key < rlkey) {
+                if (!p->right) {
+                    return next(p);
+                }
+                rlkey -= p->key;
+                p = p->right;
+            } else if (rlkey < p->key) {
+                if (!p->left) {
+                    return p;
+                }
+                rlkey -= p->key;
+                p = p->left;
+            } else {
+                return p;
+            }
+        }
+    }
+
+    node* upperbound(const Key& key, bool remember) const
+    {
+        Diff rlkey;
+        node* p = searchstart(key, rlkey);
+        if (!p)
+            return NULL;
+
+        while(1) {
+            push(p);
+            if (remember)
+                setfinger(p, key, rlkey);
+            if (p->key < rlkey) {
+                if (!p->right) {
+                    return next(p);
+                }
+                rlkey -= p->key;
+                p = p->right;
+            } else if (rlkey < p->key) {
+                if (!p->left) {
+                    return p;
+                }
+                rlkey -= p->key;
+                p = p->left;
+            } else {
+                return next(p);
+            }
+        }
+    }
+
+    node* rlowerbound(const Key& key, bool remember) const
+    {
+        Diff rlkey;
+        node* p = searchstart(key, rlkey);
+        node* leftnode = NULL;
+        if (!p)
+            return NULL;
+
+        while(true) {
+            push(p);
+            if (remember)
+                setfinger(p, key, rlkey);
+            if (p->key < rlkey) {
+                if (!p->right) {
+                    return p;
+                }
+                leftnode = p;
+                rlkey -= p->key;
+                p = p->right;
+            } else if (rlkey < p->key) {
+                if (!p->left) {
+                    //return previous(p);
+                    return leftnode;
+                }
+                rlkey -= p->key;
+                p = p->left;
+            } else {
+                return p;
+            }
+        }
+    }
+
+    node* rupperbound(const Key& key, bool remember) const
+    {
+        Diff rlkey;
+        node* p = searchstart(key, rlkey);
+        if (!p) {
+            return NULL;
+        }
+        while(1) {
+            push(p);
+            if (remember)
+                setfinger(p, key, rlkey);
+            if (p->key < rlkey) {
+                if (!p->right) {
+                    return p;
+                }
+                rlkey -= p->key;
+                p = p->right;
+            } else if (rlkey < p->key) {
+                if (!p->left) {
+                    return previous(p);
+                }
+                rlkey -= p->key;
+                p = p->left;
+            } else {
+                return previous(p);
+            }
+        }
+    }
+
+    std::pair<node*, Key> lowerbound2(const Key& key, bool remember) const
+    {
+        typedef std::pair<node*, Key> rettype;
+        Diff rlkey;
+        node* p = searchstart(key, rlkey);
+        if (!p)
+            return rettype(NULL, Key());
+
+        const Key& orgkey = key;
+        while(1) {
+            push(p);
+            if (remember)
+                setfinger(p, key, rlkey);
+            if (p->key < rlkey) {
+                rlkey -= p->key;
+                if (!p->right) {
+                    node* old;
+                    do {
+                        old = p;
+                        rlkey += p->key;
+                        p = Parent(p);
+                    } while(p && p->right == old);
+                    return rettype(p, orgkey-rlkey);
+                }
+                p = p->right;
+            } else if (rlkey < p->key) {
+                rlkey -= p->key;
+                if (!p->left) {
+                    return rettype(p, orgkey-rlkey);
+                }
+                p = p->left;
+            } else {
+                return rettype(p, orgkey);
+            }
+        }
+    }
+
+    std::pair<node*, Key> rlowerbound2(const Key& key, bool remember) const
+    {
+        typedef std::pair<node*, Key> rettype;
+        Diff rlkey;
+        node* p = searchstart(key, rlkey);
+        if (!p)
+            return rettype(NULL, Key());
+
+        const Key& orgkey = key;
+        while(true) {
+            push(p);
+            if (remember)
+                setfinger(p, key, rlkey);
+            if (p->key < rlkey) {
+                rlkey -= p->key;
+                if (!p->right) {
+                    return rettype(p, orgkey-rlkey);
+                }
+                p = p->right;
+            } else if (rlkey < p->key) {
+                rlkey -= p->key;
+                if (!p->left) {
+                    node* old;
+                    do {
+                        old = p;
+                        rlkey += p->key;
+                        p = Parent(p);
+                    } while(p && p->left == old);
+                    return rettype(p, orgkey-rlkey);
+                }
+                p = p->left;
+            } else {
+                return rettype(p, orgkey);
+            }
+        }
+    }
+
+public:
+    bool check_structure() const
+    {
+        if (mysize == 0) {
+            return (root == NULL && leftmost == NULL && rightmost == NULL);
+        } else {
+            if (root == NULL)
+                return false;
+            if (root->parent)
                 return false;
             if (leftmost == NULL || rightmost == NULL)
                 return false;
@@ -1625,7 +3191,9 @@ public:
                 return false;
             if (next(rightmost))
                 return false;
-            if (!ISBLACK(root))
+            if (!Balance::avl && !ISBLACK(root))
+                return false;
+            if (Balance::avl && !check_heights(root))
                 return false;
             
             size_t count = 1;
@@ -1637,7 +3205,7 @@ public:
                 return false;
             if (count != mysize)
                 return false;
-            if (depthmax > depthmin*2)
+            if (!Balance::avl && depthmax > depthmin*2)
                 return false;
             
             return true;
@@ -1652,7 +3220,7 @@ protected:
                  depthmax = depth;
              return true;
          }
-         if (ISRED(parent) && ISRED(p))
+         if (!Balance::avl && ISRED(parent) && ISRED(p))
              return false;
          if (p->parent != parent)
              return false;
@@ -1663,23 +3231,40 @@ protected:
              return false;
          return true;
      }
+     // every height is one more than the higher child, which differ by one at most
+     bool check_heights(const node* p) const {
+         if (!p)
+             return true;
+         const size_type hl = avlheight(p->left);
+         const size_type hr = avlheight(p->right);
+         if (hl + 1 < hr || hr + 1 < hl || p->col != 1 + (std::max)(hl, hr))
+             return false;
+         return check_heights(p->left) && check_heights(p->right);
+     }
         
 private:
     static const typename node::color Black = 0;
     static const typename node::color Red = 1;
+    // the height of a new node with avl_balance
+    static const typename node::color Leaf = 1;
     
     node* root;
     node* rightmost;
     node* leftmost;
     size_type mysize;
+    mutable node* finger;
+    mutable Key fingerkey;
+    // rightmost and its absolute key, kept for append()
+    mutable node* tail;
+    mutable Key tailkey;
 };
 
 } //namespace
 
 namespace std {
 
-template <class K, class D, class T, class A>
-void swap(gununu::slidable_map<K,D,T,A>& lhs, gununu::slidable_map<K,D,T,A>& rhs) {
+template <class K, class D, class T, class A, class G, class S, class H, class L, class W, class B>
+void swap(gununu::slidable_map<K,D,T,A,G,S,H,L,W,B>& lhs, gununu::slidable_map<K,D,T,A,G,S,H,L,W,B>& rhs) {
     lhs.swap(rhs);
 }
 
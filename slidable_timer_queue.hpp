@@ -0,0 +1,205 @@
+#ifndef SLIDABLE_TIMER_QUEUE_HPP
+#define SLIDABLE_TIMER_QUEUE_HPP
+
+#include <cassert>
+#include <list>
+#include <utility>
+#include "slidable_map.hpp"
+
+namespace gununu {
+
+// queue of timers ordered by their due times, built on slidable_map so that every timer due at
+// or after some time can be postponed at once in O(logN).
+// the timers due at the same time share a node and are kept in a list in the order they were
+// pushed, so a handle is the node and the position in the list. both stay valid until the timer
+// is popped or cancelled, even while the due times are slid.
+template <class Key, class Diff, class Type, class Alloc = std::allocator<std::pair<const Key, Type> > >
+class slidable_timer_queue
+{
+public:
+typedef Key key_type;
+typedef Type value_type;
+
+private:
+typedef typename Alloc::template rebind<Type>::other bucket_allocator;
+typedef std::list<Type, bucket_allocator> bucket;
+typedef typename Alloc::template rebind<std::pair<const Key, bucket> >::other map_allocator;
+typedef slidable_map<Key, Diff, bucket, map_allocator> map_type;
+typedef typename map_type::node node;
+
+public:
+typedef typename map_type::size_type size_type;
+
+class handle
+{
+    friend class slidable_timer_queue;
+    handle(const typename map_type::iterator& n, const typename bucket::iterator& p) : where(n), pos(p) {}
+public:
+    handle() {}
+private:
+    typename map_type::iterator where;
+    typename bucket::iterator pos;
+};
+
+    explicit slidable_timer_queue(const Alloc& a = Alloc()) : map(map_allocator(a)), count(0), headkey() {}
+
+    void swap(slidable_timer_queue& rhs)
+    {
+        map.swap(rhs.map);
+        std::swap(count, rhs.count);
+        std::swap(headkey, rhs.headkey);
+    }
+
+    size_type   size() const { return count; }
+    bool        empty() const { return !count; }
+
+    // adds a timer. a timer due after every other one is linked without a search.
+    handle push(const Key& due, const Type& value)
+    {
+        std::pair<typename map_type::iterator, bool> ret = map.append(std::make_pair(due, bucket(bucket_allocator(map.get_allocator()))));
+        typename map_type::iterator where = ret.first;
+        bucket& b = where->second();
+        try {
+            b.push_back(value);
+        } catch (...) {
+            if (ret.second)
+                map.erase(where);
+            throw;
+        }
+        ++count;
+        if (where == map.begin())
+            headkey = due;
+        return handle(where, --b.end());
+    }
+
+    // the timer which is due first. the queue must not be empty.
+    const Type& peek_min() const
+    {
+        assert(!empty());
+        return map.leftmost->value().front();
+    }
+    Type& peek_min()
+    {
+        assert(!empty());
+        return map.leftmost->value().front();
+    }
+
+    // the due time of peek_min(). it is kept up to date by every change.
+    Key next_due() const
+    {
+        assert(!empty());
+        return headkey;
+    }
+
+    Key due(const handle& h) const
+    {
+        typename map_type::iterator where = h.where;
+        return where->first();
+    }
+
+    // removes the timer of h. h and its copies become invalid.
+    void cancel(const handle& h)
+    {
+        typename map_type::iterator where = h.where;
+        bucket& b = where->second();
+        b.erase(h.pos);
+        --count;
+        if (b.empty()) {
+            const bool head = where == map.begin();
+            map.erase(where);
+            if (head)
+                reload();
+        }
+    }
+
+    // removes the timers due at or before now and writes them to out in the order of their due
+    // times, and in the order they were pushed for the same due time. the due timers are split
+    // off the tree at once and each one is removed after it is written. if out throws, the
+    // timers not written yet are put back in front of the others, and their handles stay valid.
+    template <class OutputIt>
+    OutputIt pop_due(const Key& now, OutputIt out)
+    {
+        if (map.empty() || now < headkey)
+            return out;
+        node* p = map.leftmost;
+        Key k = headkey;
+        size_type n = 0;
+        while (p && !(now < k)) {
+            p = map_type::next(p, k);
+            ++n;
+        }
+        map_type due((map.get_allocator()));
+        if (p)
+            map.split_at(k, due, map.size() - n);
+        map.swap(due);
+        typename map_type::iterator it = due.begin();
+        try {
+            for (; it != due.end(); ++it) {
+                bucket& b = it->second();
+                while (!b.empty()) {
+#ifndef BOOST_NO_RVALUE_REFERENCES
+                    *out = std::move(b.front());
+#else
+                    *out = b.front();
+#endif
+                    ++out;
+                    b.pop_front();
+                    --count;
+                }
+            }
+        } catch (...) {
+            // the nodes share the allocator, so they are linked back without copying the timers
+            due.erase(due.begin(), it);
+            due.concat(map);
+            map.swap(due);
+            reload();
+            throw;
+        }
+        reload();
+        return out;
+    }
+
+    // delays every timer due at or after t by d.
+    void postpone_after(const Key& t, const Diff& d)
+    {
+        assert(!(d < Diff()));
+        map.slide_rightkeys(t, d);
+        if (!(headkey < t))
+            headkey += d;
+    }
+
+    // delays every timer by d, e.g. while the clock is paused.
+    void postpone_all(const Diff& d)
+    {
+        map.slide_all(d);
+        headkey += d;
+    }
+
+    void clear()
+    {
+        map.clear();
+        count = 0;
+    }
+
+    friend void swap(slidable_timer_queue& lhs, slidable_timer_queue& rhs) { lhs.swap(rhs); }
+
+private:
+    slidable_timer_queue(const slidable_timer_queue&);
+    slidable_timer_queue& operator = (const slidable_timer_queue&);
+
+    // the due time of the earliest timers after the earliest node may have changed
+    void reload()
+    {
+        if (!map.empty())
+            headkey = map_type::getabkey(map.leftmost);
+    }
+
+    map_type map;
+    size_type count;
+    // the due time of the earliest timers, so that next_due() neither searches nor writes
+    Key headkey;
+};
+
+} //namespace
+
+#endif /* SLIDABLE_TIMER_QUEUE_HPP */
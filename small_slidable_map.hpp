@@ -0,0 +1,592 @@
+#ifndef SMALL_SLIDABLE_MAP_HPP
+#define SMALL_SLIDABLE_MAP_HPP
+
+#include <algorithm>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <vector>
+#include <boost/type_traits/is_nothrow_move_constructible.hpp>
+#include "slidable_map.hpp"
+
+namespace gununu {
+
+// slidable_map for maps that are small most of the time.
+// up to Threshold elements are kept in a sorted array whose keys share one offset, so that
+// slide_all() is O(1) and the other slides touch only the array. the array is allocated small and
+// grows up to Threshold. the elements are moved into a slidable_map when the array is full,
+// and back when the tree shrinks to Threshold/2.
+template <class Key, class Diff, class Type, std::size_t Threshold = 32, class Alloc = std::allocator<std::pair<const Key, Type> > >
+class small_slidable_map : Alloc
+{
+public:
+typedef slidable_map<Key, Diff, Type, Alloc> tree_type;
+typedef Key key_type;
+typedef Type mapped_type;
+typedef std::pair<const Key, Type> value_type;
+typedef Alloc allocator_type;
+typedef typename Alloc::size_type size_type;
+
+private:
+typedef std::pair<Diff, Type> entry;
+typedef typename Alloc::template rebind<tree_type>::other TreeAllocator;
+typedef typename Alloc::template rebind<entry>::other EntryAllocator;
+typedef std::vector<entry, EntryAllocator> flat_type;
+
+public:
+// the iterator is its own element: it->first() and it->second() as with slidable_map.
+// every iterator is invalidated when the elements move between the array and the tree.
+class const_iterator : public std::iterator<std::bidirectional_iterator_tag, value_type>
+{
+    friend class small_slidable_map;
+protected:
+    const_iterator(const small_slidable_map* c, size_type i, typename tree_type::iterator t)
+        : container(c), index(i), tit(t) {}
+public:
+    const_iterator() : container(NULL), index(0) {}
+
+    Key first() const {
+        return container->tree ? tit->first() : container->keyof(index);
+    }
+    const Type& second() const {
+        return container->tree ? tit->second() : container->flat[index].second;
+    }
+    const const_iterator& operator * () const { return *this; }
+    const const_iterator* operator -> () const { return this; }
+
+    const_iterator& operator ++ ()
+    {
+        if (container->tree)
+            ++tit;
+        else
+            ++index;
+        return *this;
+    }
+    const_iterator& operator -- ()
+    {
+        if (container->tree)
+            --tit;
+        else
+            --index;
+        return *this;
+    }
+    const_iterator operator ++ (int)
+    {
+        const_iterator tmp = *this;
+        ++*this;
+        return tmp;
+    }
+    const_iterator operator -- (int)
+    {
+        const_iterator tmp = *this;
+        --*this;
+        return tmp;
+    }
+    friend bool operator == (const const_iterator& lhs, const const_iterator& rhs)
+    {
+        assert(lhs.container == rhs.container);
+        return lhs.intree() ? lhs.tit == rhs.tit : lhs.index == rhs.index;
+    }
+    friend bool operator != (const const_iterator& lhs, const const_iterator& rhs)
+    {
+        return !(lhs == rhs);
+    }
+protected:
+    bool intree() const { return container && container->tree; }
+
+    const small_slidable_map* container;
+    size_type index;
+    mutable typename tree_type::iterator tit;
+};
+
+class iterator : public const_iterator
+{
+    friend class small_slidable_map;
+protected:
+    iterator(const small_slidable_map* c, size_type i, typename tree_type::iterator t) : const_iterator(c, i, t) {}
+public:
+    iterator() {}
+
+    Type& second() const {
+        if (this->container->tree)
+            return this->tit->second();
+        return const_cast<small_slidable_map*>(this->container)->flat[this->index].second;
+    }
+    const iterator& operator * () const { return *this; }
+    const iterator* operator -> () const { return this; }
+
+    iterator& operator ++ ()
+    {
+        const_iterator::operator ++ ();
+        return *this;
+    }
+    iterator& operator -- ()
+    {
+        const_iterator::operator -- ();
+        return *this;
+    }
+    iterator operator ++ (int)
+    {
+        iterator tmp = *this;
+        ++*this;
+        return tmp;
+    }
+    iterator operator -- (int)
+    {
+        iterator tmp = *this;
+        --*this;
+        return tmp;
+    }
+};
+
+// points at the element itself, as the reverse iterators of slidable_map do.
+class const_reverse_iterator : public const_iterator
+{
+    friend class small_slidable_map;
+protected:
+    const_reverse_iterator(const small_slidable_map* c, size_type i, typename tree_type::iterator t) : const_iterator(c, i, t) {}
+public:
+    const_reverse_iterator() {}
+
+    const_iterator base() const {
+        const_iterator tmp(*this);
+        return ++tmp;
+    }
+    const const_reverse_iterator& operator * () const { return *this; }
+    const const_reverse_iterator* operator -> () const { return this; }
+
+    const_reverse_iterator& operator ++ ()
+    {
+        const_iterator::operator -- ();
+        return *this;
+    }
+    const_reverse_iterator& operator -- ()
+    {
+        const_iterator::operator ++ ();
+        return *this;
+    }
+    const_reverse_iterator operator ++ (int)
+    {
+        const_reverse_iterator tmp = *this;
+        ++*this;
+        return tmp;
+    }
+    const_reverse_iterator operator -- (int)
+    {
+        const_reverse_iterator tmp = *this;
+        --*this;
+        return tmp;
+    }
+};
+
+class reverse_iterator : public const_reverse_iterator
+{
+    friend class small_slidable_map;
+protected:
+    reverse_iterator(const small_slidable_map* c, size_type i, typename tree_type::iterator t) : const_reverse_iterator(c, i, t) {}
+public:
+    reverse_iterator() {}
+
+    iterator base() const {
+        iterator tmp(this->container, this->index, this->tit);
+        return ++tmp;
+    }
+    Type& second() const {
+        if (this->container->tree)
+            return this->tit->second();
+        return const_cast<small_slidable_map*>(this->container)->flat[this->index].second;
+    }
+    const reverse_iterator& operator * () const { return *this; }
+    const reverse_iterator* operator -> () const { return this; }
+
+    reverse_iterator& operator ++ ()
+    {
+        const_reverse_iterator::operator ++ ();
+        return *this;
+    }
+    reverse_iterator& operator -- ()
+    {
+        const_reverse_iterator::operator -- ();
+        return *this;
+    }
+    reverse_iterator operator ++ (int)
+    {
+        reverse_iterator tmp = *this;
+        ++*this;
+        return tmp;
+    }
+    reverse_iterator operator -- (int)
+    {
+        reverse_iterator tmp = *this;
+        --*this;
+        return tmp;
+    }
+};
+
+public:
+    explicit small_slidable_map(const Alloc& a = Alloc()) : Alloc(a), offset(), flat(EntryAllocator(a)), tree(NULL) {}
+    small_slidable_map(const small_slidable_map& rhs) : Alloc(rhs), offset(rhs.offset), flat(rhs.flat), tree(NULL) {
+        if (rhs.tree)
+            tree = newtree(*rhs.tree);
+    }
+#ifndef BOOST_NO_RVALUE_REFERENCES
+    small_slidable_map(small_slidable_map&& rhs) : Alloc(rhs), offset(), flat(EntryAllocator(rhs)), tree(NULL) {
+        swap(rhs);
+    }
+    small_slidable_map& operator = (small_slidable_map&& rhs) {
+        assert(this != &rhs);
+        swap(rhs);
+        rhs.clear();
+        return *this;
+    }
+#endif
+    ~small_slidable_map() { deletetree(); }
+
+    small_slidable_map& operator = (const small_slidable_map& rhs)
+    {
+        if (this != &rhs) {
+            small_slidable_map tmp(rhs);
+            swap(tmp);
+        }
+        return *this;
+    }
+
+    void swap(small_slidable_map& rhs)
+    {
+        std::swap(offset, rhs.offset);
+        flat.swap(rhs.flat);
+        std::swap(tree, rhs.tree);
+    }
+
+    Alloc       get_allocator() const { return static_cast<const Alloc&>(*this); }
+    bool        empty() const { return size() == 0; }
+    size_type   size() const { return tree ? tree->size() : flat.size(); }
+    // true while the elements are in the tree
+    bool        promoted() const { return tree != NULL; }
+
+    iterator         begin() { return iterator(this, 0, tree ? tree->begin() : typename tree_type::iterator()); }
+    const_iterator   begin() const { return const_cast<small_slidable_map*>(this)->begin(); }
+    const_iterator  cbegin() const { return begin(); }
+    iterator         end() { return iterator(this, flat.size(), tree ? tree->end() : typename tree_type::iterator()); }
+    const_iterator   end() const { return const_cast<small_slidable_map*>(this)->end(); }
+    const_iterator  cend() const { return end(); }
+    // the index before the first element wraps around, so that rend() of the array is size_type(-1)
+    reverse_iterator         rbegin() { return reverse_iterator(this, flat.size() - 1, tree ? --tree->end() : typename tree_type::iterator()); }
+    const_reverse_iterator   rbegin() const { return const_cast<small_slidable_map*>(this)->rbegin(); }
+    const_reverse_iterator  crbegin() const { return rbegin(); }
+    reverse_iterator         rend() { return reverse_iterator(this, size_type(-1), tree ? tree->end() : typename tree_type::iterator()); }
+    const_reverse_iterator   rend() const { return const_cast<small_slidable_map*>(this)->rend(); }
+    const_reverse_iterator  crend() const { return rend(); }
+
+    std::pair<iterator, bool> insert(const value_type& kv)
+    {
+        if (!tree) {
+            const Diff rl = relkey(kv.first);
+            typename flat_type::iterator p = lowerentry(rl);
+            if (p != flat.end() && !(rl < p->first))
+                return std::make_pair(at_index(p - flat.begin()), false);
+            if (flat.size() < Threshold) {
+                p = insertentry(p, entry(rl, kv.second));
+                return std::make_pair(at_index(p - flat.begin()), true);
+            }
+            promote();
+        }
+        std::pair<typename tree_type::iterator, bool> ret = tree->insert(kv);
+        return std::make_pair(iterator(this, 0, ret.first), ret.second);
+    }
+
+    // the same as slidable_map: inserts val diff away from hint, which must not pass the neighbour of hint
+#ifndef BOOST_NO_RVALUE_REFERENCES
+    template <class T>
+    std::pair<iterator, bool> insert_by(const_iterator hint, Diff diff, T&& val)
+#else
+    std::pair<iterator, bool> insert_by(const_iterator hint, Diff diff, const Type& val)
+#endif
+    {
+        assert(hint.container == this && hint != end());
+        if (tree) {
+#ifndef BOOST_NO_RVALUE_REFERENCES
+            std::pair<typename tree_type::iterator, bool> ret = tree->insert_by(hint.tit, diff, std::forward<T>(val));
+#else
+            std::pair<typename tree_type::iterator, bool> ret = tree->insert_by(hint.tit, diff, val);
+#endif
+            return std::make_pair(iterator(this, 0, ret.first), ret.second);
+        }
+        const Diff rl = flat[hint.index].first + diff;
+        if (flat.size() < Threshold) {
+            typename flat_type::iterator p = flat.begin() + hint.index + (Diff() < diff ? 1 : 0);
+            assert(p == flat.begin() || (p - 1)->first < rl);
+            assert(p == flat.end() || rl < p->first);
+#ifndef BOOST_NO_RVALUE_REFERENCES
+            p = insertentry(p, entry(rl, std::forward<T>(val)));
+#else
+            p = insertentry(p, entry(rl, val));
+#endif
+            return std::make_pair(at_index(p - flat.begin()), true);
+        }
+        Key k = Key();
+        k += offset + rl;
+        promote();
+#ifndef BOOST_NO_RVALUE_REFERENCES
+        std::pair<typename tree_type::iterator, bool> ret = tree->insert(value_type(k, std::forward<T>(val)));
+#else
+        std::pair<typename tree_type::iterator, bool> ret = tree->insert(value_type(k, val));
+#endif
+        return std::make_pair(iterator(this, 0, ret.first), ret.second);
+    }
+
+    template <class InputIt>
+    void insert(InputIt first, InputIt last)
+    {
+        for (; first != last; ++first)
+            insert(*first);
+    }
+
+    Type& operator [] (const Key& key)
+    {
+        return insert(value_type(key, Type())).first->second();
+    }
+
+    Type& at(const Key& key) {
+        iterator p = find(key);
+        if (p == end())
+            throw std::out_of_range("small_slidable_map::at");
+        return p->second();
+    }
+    const Type& at(const Key& key) const {
+        return const_cast<small_slidable_map*>(this)->at(key);
+    }
+
+    iterator erase(const_iterator where)
+    {
+        assert(where.container == this);
+        if (!tree) {
+            flat.erase(flat.begin() + where.index);
+            return at_index(where.index);
+        }
+        typename tree_type::iterator next = tree->erase(where.tit);
+        if (tree->size() > Threshold / 2)
+            return iterator(this, 0, next);
+        if (next == tree->end()) {
+            demote();
+            return end();
+        }
+        const Key k = next->first();
+        demote();
+        return lower_bound(k);
+    }
+
+    size_type erase(const Key& key)
+    {
+        iterator p = find(key);
+        if (p == end())
+            return 0;
+        erase(p);
+        return 1;
+    }
+
+    void clear()
+    {
+        deletetree();
+        flat.clear();
+        offset = Diff();
+    }
+
+    iterator find(const Key& key)
+    {
+        if (tree)
+            return iterator(this, 0, tree->find(key));
+        const Diff rl = relkey(key);
+        typename flat_type::iterator p = lowerentry(rl);
+        if (p == flat.end() || rl < p->first)
+            return end();
+        return at_index(p - flat.begin());
+    }
+    const_iterator find(const Key& key) const { return const_cast<small_slidable_map*>(this)->find(key); }
+
+    size_type count(const Key& key) const { return (find(key) != end()) ? 1 : 0; }
+
+    iterator lower_bound(const Key& key)
+    {
+        if (tree)
+            return iterator(this, 0, tree->lower_bound(key));
+        return at_index(lowerentry(relkey(key)) - flat.begin());
+    }
+    const_iterator lower_bound(const Key& key) const { return const_cast<small_slidable_map*>(this)->lower_bound(key); }
+
+    iterator upper_bound(const Key& key)
+    {
+        if (tree)
+            return iterator(this, 0, tree->upper_bound(key));
+        return at_index(upperentry(relkey(key)) - flat.begin());
+    }
+    const_iterator upper_bound(const Key& key) const { return const_cast<small_slidable_map*>(this)->upper_bound(key); }
+
+    // the same as slidable_map: keys not less than bgn
+    void slide_rightkeys(const Key& bgn, const Diff& qty)
+    {
+        if (tree) {
+            tree->slide_rightkeys(bgn, qty);
+            return;
+        }
+        for (typename flat_type::iterator p = lowerentry(relkey(bgn)); p != flat.end(); ++p)
+            p->first += qty;
+    }
+
+    // the same as slidable_map: keys not greater than bgn
+    void slide_leftkeys(const Key& bgn, const Diff& qty)
+    {
+        if (tree) {
+            tree->slide_leftkeys(bgn, qty);
+            return;
+        }
+        const typename flat_type::iterator e = upperentry(relkey(bgn));
+        for (typename flat_type::iterator p = flat.begin(); p != e; ++p)
+            p->first += qty;
+    }
+
+    void slide_all(const Diff& qty)
+    {
+        if (tree) {
+            tree->slide_all(qty);
+            return;
+        }
+        offset += qty;
+    }
+
+    // the same as slidable_map: the key must not pass the neighbours of where
+    void movekey(const_iterator where, const Diff& qty)
+    {
+        assert(where.container == this && where != end());
+        if (tree) {
+            tree->movekey(where.tit, qty);
+            return;
+        }
+        entry& e = flat[where.index];
+        e.first += qty;
+        assert(where.index == 0 || flat[where.index - 1].first < e.first);
+        assert(where.index + 1 == flat.size() || e.first < flat[where.index + 1].first);
+    }
+
+    friend void swap(small_slidable_map& lhs, small_slidable_map& rhs) { lhs.swap(rhs); }
+
+private:
+    struct entry_less {
+        bool operator () (const entry& lhs, const Diff& rhs) const { return lhs.first < rhs; }
+        bool operator () (const Diff& lhs, const entry& rhs) const { return lhs < rhs.first; }
+    };
+
+    Diff relkey(const Key& key) const { return (key - Key()) - offset; }
+    Key keyof(size_type i) const {
+        Key k = Key();
+        k += offset + flat[i].first;
+        return k;
+    }
+    typename flat_type::iterator lowerentry(const Diff& rl) {
+        return std::lower_bound(flat.begin(), flat.end(), rl, entry_less());
+    }
+    typename flat_type::iterator upperentry(const Diff& rl) {
+        return std::upper_bound(flat.begin(), flat.end(), rl, entry_less());
+    }
+    iterator at_index(size_type i) {
+        return iterator(this, i, typename tree_type::iterator());
+    }
+    // the array grows twice as large each time it is full, up to Threshold.
+    // nothing is changed if this throws and moving Type does not throw.
+    typename flat_type::iterator insertentry(typename flat_type::iterator p, entry e) {
+        assert(flat.size() < Threshold);
+        if (flat.size() == flat.capacity()) {
+            const size_type i = p - flat.begin();
+            flat.reserve(std::min<size_type>(Threshold, std::max<size_type>(4, flat.capacity() * 2)));
+            p = flat.begin() + i;
+        }
+#ifndef BOOST_NO_RVALUE_REFERENCES
+        return flat.insert(p, std::move(e));
+#else
+        return flat.insert(p, e);
+#endif
+    }
+
+    tree_type* newtree(const tree_type& org)
+    {
+        TreeAllocator a(static_cast<const Alloc&>(*this));
+        tree_type* t = a.allocate(1);
+        try {
+            new ((void*)t) tree_type(org);
+        } catch (...) {
+            a.deallocate(t, 1);
+            throw;
+        }
+        return t;
+    }
+    void deletetree()
+    {
+        if (!tree)
+            return;
+        TreeAllocator a(static_cast<const Alloc&>(*this));
+        tree->~tree_type();
+        a.deallocate(tree, 1);
+        tree = NULL;
+    }
+
+    // moves the array into a new tree. the array is left as it was if this throws.
+    void promote()
+    {
+        tree_type* t = newtree(tree_type(get_allocator()));
+        size_type i = 0;
+        try {
+            for (; i<flat.size(); ++i) {
+#ifndef BOOST_NO_RVALUE_REFERENCES
+                // the value is moved when the node has been allocated, so that nothing is lost if that fails
+                if (boost::is_nothrow_move_constructible<Type>::value)
+                    t->insert(std::pair<Key, Type&&>(keyof(i), std::move(flat[i].second)));
+                else
+#endif
+                    t->insert(value_type(keyof(i), flat[i].second));
+            }
+        } catch (...) {
+#ifndef BOOST_NO_RVALUE_REFERENCES
+            if (boost::is_nothrow_move_constructible<Type>::value) {
+                i = 0;
+                for (typename tree_type::iterator p = t->begin(); p != t->end(); ++p, ++i)
+                    flat[i].second = std::move(p->second());
+            }
+#endif
+            tree = t;
+            deletetree();
+            throw;
+        }
+        tree = t;
+        flat_type(EntryAllocator(get_allocator())).swap(flat);
+        offset = Diff();
+    }
+
+    // moves the tree back into an array allocated for its elements. if the allocation or copying
+    // a value throws, the elements stay in the tree and the map is demoted by a later erase.
+    void demote() BOOST_NOEXCEPT
+    {
+        assert(flat.empty() && tree->size() <= Threshold);
+        try {
+            flat.reserve(tree->size());
+            for (typename tree_type::iterator p = tree->begin(); p != tree->end(); ++p)
+#ifndef BOOST_NO_RVALUE_REFERENCES
+                flat.push_back(entry(p->first() - Key(), std::move_if_noexcept(p->second())));
+#else
+                flat.push_back(entry(p->first() - Key(), p->second()));
+#endif
+        } catch (...) {
+            flat.clear();
+            return;
+        }
+        deletetree();
+        offset = Diff();
+    }
+
+    Diff offset;
+    flat_type flat;
+    tree_type* tree;
+};
+
+} //namespace
+
+#endif /* SMALL_SLIDABLE_MAP_HPP */
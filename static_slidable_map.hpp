@@ -0,0 +1,208 @@
+#ifndef STATIC_SLIDABLE_MAP_HPP
+#define STATIC_SLIDABLE_MAP_HPP
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <boost/config.hpp>
+#include <boost/integer.hpp>
+#include <boost/type_traits/aligned_storage.hpp>
+#include <boost/type_traits/alignment_of.hpp>
+#include <boost/type_traits/has_nothrow_copy.hpp>
+#include "slidable_map.hpp"
+
+namespace gununu {
+
+namespace detail {
+// Capacity slots of Size bytes in the object. the free slots are linked by their indices.
+template <std::size_t Size, std::size_t Align, std::size_t Capacity>
+class slot_arena {
+public:
+    typedef typename boost::uint_value_t<Capacity>::least index_type;
+    static const std::size_t slot_size = Size;
+
+    slot_arena() : head(0) {
+        for (std::size_t i=0; i<Capacity; ++i)
+            next[i] = static_cast<index_type>(i + 1);
+    }
+
+    // NULL if every slot is taken
+    void* take() BOOST_NOEXCEPT {
+        if (head == Capacity)
+            return NULL;
+        const index_type i = head;
+        head = next[i];
+        return slot(i);
+    }
+    void give(void* p) BOOST_NOEXCEPT {
+        const index_type i = static_cast<index_type>((static_cast<char*>(p) - static_cast<char*>(slot(0))) / Size);
+        assert(i < Capacity);
+        next[i] = head;
+        head = i;
+    }
+private:
+    slot_arena(const slot_arena&);
+    slot_arena& operator = (const slot_arena&);
+
+    void* slot(std::size_t i) { return static_cast<char*>(static_cast<void*>(&storage)) + i * Size; }
+
+    typename boost::aligned_storage<Size * Capacity, Align>::type storage;
+    index_type next[Capacity];
+    index_type head;
+};
+
+// allocator of single objects from a slot_arena. it throws std::bad_alloc if the arena is full,
+// which static_slidable_map never lets happen.
+template <class T, class Arena>
+class arena_allocator {
+    template <class, class> friend class arena_allocator;
+public:
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef std::size_t size_type;
+    typedef std::ptrdiff_t difference_type;
+    template <class U>
+    struct rebind { typedef arena_allocator<U, Arena> other; };
+
+    explicit arena_allocator(Arena* a) : arena(a) {}
+    template <class U>
+    arena_allocator(const arena_allocator<U, Arena>& r) : arena(r.arena) {}
+
+    pointer allocate(size_type n, const void* = NULL) {
+        if (n == 1 && sizeof(T) <= Arena::slot_size) {
+            if (void* p = arena->take())
+                return static_cast<pointer>(p);
+        }
+        throw std::bad_alloc();
+    }
+    void deallocate(pointer p, size_type) BOOST_NOEXCEPT { arena->give(p); }
+    void construct(pointer p, const T& val) { new ((void*)p) T(val); }
+    void destroy(pointer p) { p->~T(); }
+    size_type max_size() const BOOST_NOEXCEPT { return 1; }
+
+    template <class U>
+    friend bool operator == (const arena_allocator& lhs, const arena_allocator<U, Arena>& rhs) { return lhs.arena == rhs.arena; }
+    template <class U>
+    friend bool operator != (const arena_allocator& lhs, const arena_allocator<U, Arena>& rhs) { return lhs.arena != rhs.arena; }
+private:
+    Arena* arena;
+};
+}
+
+// slidable_map of at most Capacity elements which never calls the allocator, e.g. for a real-time
+// thread. the nodes live in the object and the free ones are linked by indices.
+// insert reports a full map by returning end() instead of throwing. every operation is nothrow
+// as long as the copy of Type is.
+template <class Key, class Diff, class Type, std::size_t Capacity>
+class static_slidable_map
+{
+    BOOST_STATIC_ASSERT(Capacity > 0);
+    typedef detail::node_base<Diff, Type> node;
+    typedef detail::slot_arena<sizeof(node), boost::alignment_of<node>::value, Capacity> arena_type;
+    typedef detail::arena_allocator<std::pair<const Key, Type>, arena_type> allocator_type;
+    typedef slidable_map<Key, Diff, Type, allocator_type> map_type;
+    static const bool nothrow_insert = boost::has_nothrow_copy<Type>::value;
+public:
+    typedef Key key_type;
+    typedef Type mapped_type;
+    typedef typename map_type::value_type value_type;
+    typedef std::size_t size_type;
+    typedef typename map_type::iterator iterator;
+    typedef typename map_type::const_iterator const_iterator;
+    typedef typename map_type::reverse_iterator reverse_iterator;
+    typedef typename map_type::const_reverse_iterator const_reverse_iterator;
+
+    static_slidable_map() : map(allocator_type(&arena)) {}
+    static_slidable_map(const static_slidable_map& rhs) : map(rhs.map, allocator_type(&arena)) {}
+
+    static_slidable_map& operator = (const static_slidable_map& rhs)
+    {
+        if (this != &rhs) {
+            map.clear();
+            for (const_iterator p = rhs.begin(); p != rhs.end(); ++p)
+                map.insert(value_type(p->first(), p->second()));
+        }
+        return *this;
+    }
+
+    static size_type capacity() BOOST_NOEXCEPT { return Capacity; }
+    static size_type max_size() BOOST_NOEXCEPT { return Capacity; }
+    size_type   size() const BOOST_NOEXCEPT { return map.size(); }
+    bool        empty() const BOOST_NOEXCEPT { return map.empty(); }
+    bool        full() const BOOST_NOEXCEPT { return map.size() == Capacity; }
+
+    iterator         begin() BOOST_NOEXCEPT { return map.begin(); }
+    const_iterator   begin() const BOOST_NOEXCEPT { return map.begin(); }
+    const_iterator  cbegin() const BOOST_NOEXCEPT { return map.begin(); }
+    iterator         end() BOOST_NOEXCEPT { return map.end(); }
+    const_iterator   end() const BOOST_NOEXCEPT { return map.end(); }
+    const_iterator  cend() const BOOST_NOEXCEPT { return map.end(); }
+    reverse_iterator         rbegin() BOOST_NOEXCEPT { return map.rbegin(); }
+    const_reverse_iterator   rbegin() const BOOST_NOEXCEPT { return map.rbegin(); }
+    reverse_iterator         rend() BOOST_NOEXCEPT { return map.rend(); }
+    const_reverse_iterator   rend() const BOOST_NOEXCEPT { return map.rend(); }
+
+    // returns end() and false if the key is not in the map and the map is full.
+    std::pair<iterator, bool> insert(const value_type& kv) BOOST_NOEXCEPT_IF(nothrow_insert)
+    {
+        if (full())
+            return std::make_pair(map.find(kv.first), false);
+        return map.insert(kv);
+    }
+
+    // the same as slidable_map::insert_by. returns end() and false if the map is full.
+    std::pair<iterator, bool> insert_by(const_iterator hint, const Diff& diff, const Type& val) BOOST_NOEXCEPT_IF(nothrow_insert)
+    {
+        if (full())
+            return std::make_pair(end(), false);
+        return map.insert_by(hint, diff, val);
+    }
+
+    // the same as slidable_map::append. returns the same as insert if the map is full.
+    std::pair<iterator, bool> append(const value_type& kv) BOOST_NOEXCEPT_IF(nothrow_insert)
+    {
+        if (full())
+            return std::make_pair(map.find(kv.first), false);
+        return map.append(kv);
+    }
+
+    iterator erase(const_iterator where) BOOST_NOEXCEPT { return map.erase(where); }
+    size_type erase(const Key& key) BOOST_NOEXCEPT { return map.erase(key); }
+    iterator erase(const_iterator first, const_iterator last) BOOST_NOEXCEPT { return map.erase(first, last); }
+    void clear() BOOST_NOEXCEPT { map.clear(); }
+
+    iterator find(const Key& key) BOOST_NOEXCEPT { return map.find(key); }
+    const_iterator find(const Key& key) const BOOST_NOEXCEPT { return map.find(key); }
+    size_type count(const Key& key) const BOOST_NOEXCEPT { return map.count(key); }
+    iterator lower_bound(const Key& key) BOOST_NOEXCEPT { return map.lower_bound(key); }
+    const_iterator lower_bound(const Key& key) const BOOST_NOEXCEPT { return map.lower_bound(key); }
+    iterator upper_bound(const Key& key) BOOST_NOEXCEPT { return map.upper_bound(key); }
+    const_iterator upper_bound(const Key& key) const BOOST_NOEXCEPT { return map.upper_bound(key); }
+    iterator rlower_bound(const Key& key) BOOST_NOEXCEPT { return map.rlower_bound(key); }
+    const_iterator rlower_bound(const Key& key) const BOOST_NOEXCEPT { return map.rlower_bound(key); }
+    iterator rupper_bound(const Key& key) BOOST_NOEXCEPT { return map.rupper_bound(key); }
+    const_iterator rupper_bound(const Key& key) const BOOST_NOEXCEPT { return map.rupper_bound(key); }
+    std::pair<iterator, Key> lower_bound2(const Key& key) BOOST_NOEXCEPT { return map.lower_bound2(key); }
+    std::pair<const_iterator, Key> lower_bound2(const Key& key) const BOOST_NOEXCEPT { return map.lower_bound2(key); }
+    std::pair<iterator, Key> rlower_bound2(const Key& key) BOOST_NOEXCEPT { return map.rlower_bound2(key); }
+    std::pair<const_iterator, Key> rlower_bound2(const Key& key) const BOOST_NOEXCEPT { return map.rlower_bound2(key); }
+    std::pair<iterator, iterator> equal_range(const Key& key) BOOST_NOEXCEPT { return map.equal_range(key); }
+    std::pair<const_iterator, const_iterator> equal_range(const Key& key) const BOOST_NOEXCEPT { return map.equal_range(key); }
+
+    void slide_rightkeys(const Key& bgn, const Diff& qty) BOOST_NOEXCEPT { map.slide_rightkeys(bgn, qty); }
+    void slide_leftkeys(const Key& bgn, const Diff& qty) BOOST_NOEXCEPT { map.slide_leftkeys(bgn, qty); }
+    void slide_all(const Diff& qty) BOOST_NOEXCEPT { map.slide_all(qty); }
+    void movekey(const_iterator where, const Diff& qty) BOOST_NOEXCEPT { map.movekey(where, qty); }
+
+private:
+    // declared before map so that the nodes outlive it
+    arena_type arena;
+    map_type map;
+};
+
+} //namespace
+
+#endif /* STATIC_SLIDABLE_MAP_HPP */
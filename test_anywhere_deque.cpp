@@ -1,6 +1,9 @@
 #include <iostream>
 #include <vector>
 #include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <boost/cstdint.hpp>
 #include <boost/random.hpp>
 #include "anywhere_deque.hpp"
 using namespace std;
@@ -266,9 +269,9 @@ void ad_random_erase_range(boost::random::mt19937& mt) {
         boost::random::uniform_int_distribution<> r(0, 5);
         int m = r(mt);
         auto a = q.begin() + n;
-        m = (std::min)(q.end()-a, m);
+        m = (std::min<std::ptrdiff_t>)(q.end()-a, m);
         auto b = v.begin() + n;
-        int o = (std::min)(v.end()-b, m);
+        int o = (std::min<std::ptrdiff_t>)(v.end()-b, m);
         q.erase(a, a + m);
         v.erase(b, b + o);
     }
@@ -276,6 +279,459 @@ void ad_random_erase_range(boost::random::mt19937& mt) {
     GUNUNU_CHECK(std::equal(q.begin(),q.end(),v.begin()));
 }
 
+void ad_split_concat(boost::random::mt19937& mt) {
+    anywhere_deque<int> q;
+    vector<int> v;
+    for (int i=0; i<10000; ++i) {
+        q.push_back(i);
+        v.push_back(i);
+    }
+
+    for (int i=0; i<1000; ++i) {
+        boost::random::uniform_int_distribution<> ud(0, q.size());
+        int n = ud(mt);
+        anywhere_deque<int> r = q.split(q.begin()+n);
+        GUNUNU_CHECK(q.size() == (size_t)n);
+        GUNUNU_CHECK(r.size() == v.size()-n);
+        GUNUNU_CHECK(std::equal(q.begin(),q.end(),v.begin()));
+        GUNUNU_CHECK(std::equal(r.begin(),r.end(),v.begin()+n));
+
+        r.concat(q);
+        GUNUNU_CHECK(q.empty());
+        std::rotate(v.begin(), v.begin()+n, v.end());
+        GUNUNU_CHECK(r.size() == v.size());
+        GUNUNU_CHECK(std::equal(r.begin(),r.end(),v.begin()));
+        q.swap(r);
+
+        boost::random::uniform_int_distribution<> ue(0, q.size()-1);
+        int m = ue(mt);
+        q.erase(q.begin()+m);
+        v.erase(v.begin()+m);
+        q.insert(q.begin()+m/2, m);
+        v.insert(v.begin()+m/2, m);
+    }
+    GUNUNU_CHECK(std::equal(q.begin(),q.end(),v.begin()));
+}
+
+void ad_splice(boost::random::mt19937& mt) {
+    anywhere_deque<int> q, s;
+    vector<int> v, w;
+    for (int i=0; i<5000; ++i) {
+        q.push_back(i);
+        v.push_back(i);
+        s.push_back(-i);
+        w.push_back(-i);
+    }
+
+    for (int i=0; i<1000; ++i) {
+        boost::random::uniform_int_distribution<> uf(0, s.size());
+        int f = uf(mt);
+        boost::random::uniform_int_distribution<> ul(f, s.size());
+        int l = ul(mt);
+        boost::random::uniform_int_distribution<> up(0, q.size());
+        int p = up(mt);
+        q.splice(q.begin()+p, s, s.begin()+f, s.begin()+l);
+        v.insert(v.begin()+p, w.begin()+f, w.begin()+l);
+        w.erase(w.begin()+f, w.begin()+l);
+        GUNUNU_CHECK(q.size() == v.size());
+        GUNUNU_CHECK(s.size() == w.size());
+        q.swap(s);
+        v.swap(w);
+    }
+    GUNUNU_CHECK(std::equal(q.begin(),q.end(),v.begin()));
+    GUNUNU_CHECK(std::equal(s.begin(),s.end(),w.begin()));
+
+    for (int i=0; i<1000; ++i) {
+        boost::random::uniform_int_distribution<> uf(0, q.size());
+        int f = uf(mt);
+        boost::random::uniform_int_distribution<> ul(f, q.size());
+        int l = ul(mt);
+        boost::random::uniform_int_distribution<> up(0, q.size());
+        int p = up(mt);
+        q.splice(q.begin()+p, q, q.begin()+f, q.begin()+l);
+        if (p < f)
+            std::rotate(v.begin()+p, v.begin()+f, v.begin()+l);
+        else if (l < p)
+            std::rotate(v.begin()+f, v.begin()+l, v.begin()+p);
+    }
+    GUNUNU_CHECK(q.size() == v.size());
+    GUNUNU_CHECK(std::equal(q.begin(),q.end(),v.begin()));
+}
+
+void ad_reverse_rotate(boost::random::mt19937& mt) {
+    anywhere_deque<int> q;
+    vector<int> v;
+    for (int i=0; i<10000; ++i) {
+        q.push_back(i);
+        v.push_back(i);
+    }
+
+    for (int i=0; i<2000; ++i) {
+        boost::random::uniform_int_distribution<> uf(0, q.size());
+        int f = uf(mt);
+        boost::random::uniform_int_distribution<> ul(f, q.size());
+        int l = ul(mt);
+        boost::random::uniform_int_distribution<> um(f, l);
+        int m = um(mt);
+        switch (i % 4) {
+        case 0:
+        case 1:
+            q.reverse(q.begin()+f, q.begin()+l);
+            std::reverse(v.begin()+f, v.begin()+l);
+            break;
+        case 2:
+            GUNUNU_CHECK(q.rotate(q.begin()+f, q.begin()+m, q.begin()+l) - q.begin() == std::rotate(v.begin()+f, v.begin()+m, v.begin()+l) - v.begin());
+            break;
+        default:
+            q.insert(q.begin()+m, i);
+            v.insert(v.begin()+m, i);
+            q.erase(q.begin()+f/2);
+            v.erase(v.begin()+f/2);
+            break;
+        }
+    }
+    GUNUNU_CHECK(q.size() == v.size());
+    GUNUNU_CHECK(std::equal(q.begin(),q.end(),v.begin()));
+    GUNUNU_CHECK(std::equal(q.rbegin(),q.rend(),v.rbegin()));
+    GUNUNU_CHECK(q.front() == v.front());
+    GUNUNU_CHECK(q.back() == v.back());
+}
+
+struct ad_sum {
+    ad_sum() : sum(0), count(0) {}
+    void operator () (int x) {
+        sum += x;
+        ++count;
+    }
+    long long sum;
+    size_t count;
+};
+
+void ad_node_walking_algorithm(boost::random::mt19937& mt) {
+    anywhere_deque<int> q;
+    vector<int> v;
+    for (int i=0; i<10000; ++i) {
+        boost::random::uniform_int_distribution<> ud(0, q.size());
+        int n = ud(mt);
+        q.insert(q.begin()+n, i);
+        v.insert(v.begin()+n, i);
+    }
+    const anywhere_deque<int>& cq = q;
+
+    vector<int> w(v.size());
+    GUNUNU_CHECK(gununu::copy(q.begin(), q.end(), w.begin()) == w.end());
+    GUNUNU_CHECK(w == v);
+    GUNUNU_CHECK(gununu::accumulate(cq.begin(), cq.end(), 0LL) == std::accumulate(v.begin(), v.end(), 0LL));
+
+    ad_sum s = gununu::for_each(cq.begin()+10, cq.end()-10, ad_sum());
+    GUNUNU_CHECK(s.count == v.size()-20);
+    GUNUNU_CHECK(s.sum == std::accumulate(v.begin()+10, v.end()-10, 0LL));
+
+    for (int i=0; i<100; ++i) {
+        boost::random::uniform_int_distribution<> ud(0, v.size()+100);
+        int val = ud(mt);
+        anywhere_deque<int>::const_iterator it = gununu::find(cq.begin(), cq.end(), val);
+        GUNUNU_CHECK(it - cq.begin() == std::find(v.begin(), v.end(), val) - v.begin());
+    }
+
+    gununu::fill(q.begin()+100, q.begin()+200, -1);
+    std::fill(v.begin()+100, v.begin()+200, -1);
+    GUNUNU_CHECK(std::equal(q.begin(),q.end(),v.begin()));
+    GUNUNU_CHECK(gununu::find(q.begin(), q.end(), -1) == q.begin()+100);
+}
+
+void ad_construct_resize(boost::random::mt19937& mt) {
+    for (int n=0; n<200; ++n) {
+        vector<int> v(n);
+        for (int i=0; i<n; ++i)
+            v[i] = i;
+        anywhere_deque<int> q(v.begin(), v.end());
+        GUNUNU_CHECK(q.size() == v.size());
+        GUNUNU_CHECK(std::equal(q.begin(),q.end(),v.begin()));
+
+        anywhere_deque<int> r(n, 5);
+        GUNUNU_CHECK(r.size() == (size_t)n);
+        GUNUNU_CHECK(std::count(r.begin(), r.end(), 5) == n);
+        r.assign(v.begin(), v.end());
+        GUNUNU_CHECK(r == q);
+        r.assign(n/2, 1);
+        GUNUNU_CHECK(r.size() == (size_t)n/2);
+
+        boost::random::uniform_int_distribution<> ud(0, 2*n);
+        size_t m = ud(mt);
+        q.resize(m, -1);
+        v.resize(m, -1);
+        GUNUNU_CHECK(q.size() == v.size());
+        GUNUNU_CHECK(std::equal(q.begin(),q.end(),v.begin()));
+        q.insert(q.begin()+m/2, (size_t)n, 3);
+        v.insert(v.begin()+m/2, (size_t)n, 3);
+        q.push_front(1);
+        v.insert(v.begin(), 1);
+        q.erase(q.begin()+m/3);
+        v.erase(v.begin()+m/3);
+        GUNUNU_CHECK(std::equal(q.begin(),q.end(),v.begin()));
+    }
+}
+
+struct ad_identity {
+    int operator()(int x) const { return x; }
+};
+
+struct ad_length {
+    int operator()(const string& s) const { return (int)s.size(); }
+};
+
+void ad_weighted(boost::random::mt19937& mt) {
+    for (int gap : {0, 8}) {
+        boost::random::uniform_int_distribution<> ud(0, 5);
+        anywhere_deque<string, std::allocator<string>, ad_length> q;
+        q.set_gap_limit(gap);
+        vector<string> v;
+        int n = 0;
+        for (int i=0; i<300; ++i) {
+            boost::random::uniform_int_distribution<> pos(0, (int)v.size());
+            // stays around the same position now and then so that the gap fills up
+            if (ud(mt) < 3)
+                n = pos(mt);
+            n = std::min<int>(n, (int)v.size());
+            string s(ud(mt), 'a');
+            if (ud(mt) == 0 && !v.empty()) {
+                n = std::min<int>(n, (int)v.size()-1);
+                q.erase(q.begin()+n);
+                v.erase(v.begin()+n);
+            } else {
+                q.insert(q.begin()+n, s);
+                v.insert(v.begin()+n, s);
+            }
+            if (ud(mt) == 0 && !v.empty()) {
+                n = std::min<int>(n, (int)v.size()-1);
+                q[n] += "bb";
+                v[n] += "bb";
+                q.reweigh(q.begin()+n);
+            }
+            if (i % 50 == 0) {
+                q.reverse(q.begin(), q.end());
+                std::reverse(v.begin(), v.end());
+            }
+            // const members read through the gap
+            const anywhere_deque<string, std::allocator<string>, ad_length>& c = q;
+            int total = 0;
+            for (size_t j=0; j<v.size(); ++j) {
+                GUNUNU_CHECK(c.prefix_weight(j) == total);
+                for (size_t k=0; k<v[j].size(); ++k)
+                    GUNUNU_CHECK(c.find_by_weight(total+(int)k) == c.begin()+j);
+                total += (int)v[j].size();
+            }
+            GUNUNU_CHECK(c.prefix_weight(v.size()) == total);
+            GUNUNU_CHECK(c.total_weight() == total);
+            GUNUNU_CHECK(c.find_by_weight(total) == c.end());
+        }
+    }
+}
+
+// fill and for_each write to the elements and keep their weights up to date
+void ad_weighted_algorithm(boost::random::mt19937& mt) {
+    for (int gap : {0, 8}) {
+        typedef anywhere_deque<int, std::allocator<int>, ad_identity> que;
+        que q;
+        q.set_gap_limit(gap);
+        vector<int> v;
+        for (int i=0; i<200; ++i) {
+            boost::random::uniform_int_distribution<> pos(0, (int)v.size());
+            int n = pos(mt);
+            q.insert(q.begin()+n, 1);
+            v.insert(v.begin()+n, 1);
+        }
+        boost::random::uniform_int_distribution<> ud(0, 199);
+        for (int i=0; i<50; ++i) {
+            int a = ud(mt), b = ud(mt);
+            if (a > b)
+                std::swap(a, b);
+            // leaves some elements in the gap
+            q.insert(q.begin()+a, 3);
+            v.insert(v.begin()+a, 3);
+            if (i % 2) {
+                gununu::fill(q.begin()+a, q.begin()+b, i);
+                std::fill(v.begin()+a, v.begin()+b, i);
+            } else {
+                gununu::for_each(q.begin()+a, q.begin()+b, [](int& x) { x += 2; });
+                std::for_each(v.begin()+a, v.begin()+b, [](int& x) { x += 2; });
+            }
+            // the elements after the written range move
+            q.erase(q.begin()+b);
+            v.erase(v.begin()+b);
+            const que& c = q;
+            int total = 0;
+            for (size_t j=0; j<v.size(); ++j) {
+                GUNUNU_CHECK(c.prefix_weight(j) == total);
+                if (v[j])
+                    GUNUNU_CHECK(c.find_by_weight(total) == c.begin()+j);
+                total += v[j];
+            }
+            GUNUNU_CHECK(c.total_weight() == total);
+            GUNUNU_CHECK(std::equal(q.begin(),q.end(),v.begin()));
+        }
+    }
+    anywhere_deque<int, std::allocator<int>, ad_identity> w(10u, 1);
+    gununu::fill(w.begin(), w.end(), 5);
+    GUNUNU_CHECK(w.total_weight() == 50);
+    GUNUNU_CHECK(w.prefix_weight(4) == 20);
+    GUNUNU_CHECK(w.find_by_weight(27) == w.begin()+5);
+    gununu::for_each(w.begin()+2, w.begin()+4, [](int& x) { x = 0; });
+    GUNUNU_CHECK(w.total_weight() == 40);
+    GUNUNU_CHECK(w.find_by_weight(10) == w.begin()+4);
+    // an exception leaves the weights of the elements written so far correct
+    try {
+        gununu::for_each(w.begin(), w.end(), [](int& x) { if (x == 0) throw 0; x = 2; });
+    } catch (int) {
+    }
+    GUNUNU_CHECK(w.total_weight() == 34);
+    GUNUNU_CHECK(w.prefix_weight(2) == 4);
+}
+
+void ad_gap(boost::random::mt19937& mt) {
+    anywhere_deque<int> q;
+    q.set_gap_limit(16);
+    vector<int> v;
+    size_t cur = 0;
+    for (int i=0; i<5000; ++i) {
+        boost::random::uniform_int_distribution<> ud(0, 9);
+        int op = ud(mt);
+        if (op < 6) {
+            q.insert(q.begin()+cur, i);
+            v.insert(v.begin()+cur, i);
+            ++cur;
+        } else if (op < 8 && cur) {
+            --cur;
+            q.erase(q.begin()+cur);
+            v.erase(v.begin()+cur);
+        } else if (op == 8) {
+            boost::random::uniform_int_distribution<size_t> pos(0, v.size());
+            cur = pos(mt);
+        } else if (!v.empty()) {
+            GUNUNU_CHECK(q.front() == v.front() && q.back() == v.back());
+        }
+        GUNUNU_CHECK(q.size() == v.size());
+        if (!v.empty())
+            GUNUNU_CHECK(q[cur ? cur-1 : 0] == v[cur ? cur-1 : 0]);
+    }
+    GUNUNU_CHECK(std::equal(q.begin(),q.end(),v.begin()));
+    anywhere_deque<int> r(q);
+    GUNUNU_CHECK(r == q);
+    const anywhere_deque<int>& c = q;
+    GUNUNU_CHECK(!(c < r) && !(r < c));
+    vector<int> w;
+    gununu::copy(c.begin(), c.end(), std::back_inserter(w));
+    GUNUNU_CHECK(w == v);
+    // the gap moves with the elements
+    anywhere_deque<int> m(std::move(r));
+    GUNUNU_CHECK(m == q && r.empty());
+    r = std::move(m);
+    GUNUNU_CHECK(r == q && m.empty());
+    r.insert(r.begin() + cur, -1);
+    r.erase(r.begin() + cur);
+    m.push_back(1);
+    GUNUNU_CHECK(r == q && m.size() == 1 && m.front() == 1);
+    q.flush();
+    GUNUNU_CHECK(std::equal(q.begin(),q.end(),v.begin()));
+}
+
+void ad_apply_edits(boost::random::mt19937& mt) {
+    for (int n=0; n<100; ++n) {
+        vector<int> v(n*10);
+        for (size_t i=0; i<v.size(); ++i)
+            v[i] = (int)i;
+        anywhere_deque<int> q(v.begin(), v.end());
+        vector<int> src(50);
+        for (size_t i=0; i<src.size(); ++i)
+            src[i] = -(int)i;
+
+        boost::random::uniform_int_distribution<> ud(0, 5);
+        vector<edit_op<vector<int>::const_iterator> > edits;
+        for (size_t i=0; i<=v.size(); i+=ud(mt)) {
+            size_t erase = std::min<size_t>(ud(mt), v.size() - i);
+            size_t len = ud(mt);
+            edits.push_back(make_edit(i, erase, src.cbegin(), src.cbegin()+len));
+            i += erase;
+        }
+        for (size_t i=edits.size(); i-- > 0;) {
+            v.erase(v.begin()+edits[i].index, v.begin()+edits[i].index+edits[i].erase);
+            v.insert(v.begin()+edits[i].index, edits[i].first, edits[i].last);
+        }
+        q.apply_edits(edits.begin(), edits.end());
+        GUNUNU_CHECK(q.size() == v.size());
+        GUNUNU_CHECK(std::equal(q.begin(),q.end(),v.begin()));
+    }
+}
+
+void ad_sort(boost::random::mt19937& mt) {
+    for (size_t n : {0, 1, 100, 100000}) {
+        boost::random::uniform_int_distribution<> ud(0, 1000);
+        vector<std::pair<int,int> > v(n);
+        for (size_t i=0; i<n; ++i)
+            v[i] = std::make_pair(ud(mt), (int)i);
+        anywhere_deque<std::pair<int,int> > q(v.begin(), v.end());
+        q.reverse(q.begin(), q.end());
+        std::reverse(v.begin(), v.end());
+        auto first_less = [](const std::pair<int,int>& a, const std::pair<int,int>& b) { return a.first < b.first; };
+        q.stable_sort(first_less);
+        std::stable_sort(v.begin(), v.end(), first_less);
+        GUNUNU_CHECK(q.size() == v.size());
+        GUNUNU_CHECK(std::equal(q.begin(),q.end(),v.begin()));
+        q.sort(std::greater<std::pair<int,int> >());
+        GUNUNU_CHECK(std::is_sorted(q.begin(), q.end(), std::greater<std::pair<int,int> >()));
+    }
+    anywhere_deque<int, std::allocator<int>, ad_identity> w;
+    for (int i=0; i<1000; ++i)
+        w.push_back(i % 7);
+    w.sort();
+    GUNUNU_CHECK(std::is_sorted(w.begin(), w.end()));
+    GUNUNU_CHECK(w.total_weight() == 2997);
+    GUNUNU_CHECK(w.find_by_weight(0) - w.begin() == 143);
+}
+
+void ad_narrow_keys() {
+    std::allocator<int> a;
+    GUNUNU_CHECK(anywhere_deque<int>().max_size() == std::allocator_traits<std::allocator<int> >::max_size(a));
+    // 16 bit keys hold at most 2^14 elements
+    typedef anywhere_deque<int, std::allocator<int>, void, narrow_keys<boost::int16_t> > que;
+    que q(16380u, 1);
+    GUNUNU_CHECK(q.max_size() == 16384);
+    q.insert(q.begin() + 5, 4u, 2);
+    GUNUNU_CHECK(q.size() == q.max_size());
+
+    // every insertion beyond it throws and changes nothing
+    bool thrown = false;
+    try {
+        q.insert(q.begin() + 100, 3);
+    } catch (std::overflow_error&) {
+        thrown = true;
+    }
+    GUNUNU_CHECK(thrown && q.size() == 16384 && q[100] == 1 && q[5] == 2);
+    que r(3u, 7);
+    thrown = false;
+    try {
+        q.splice(q.begin() + 10, r, r.begin(), r.end());
+    } catch (std::overflow_error&) {
+        thrown = true;
+    }
+    GUNUNU_CHECK(thrown && q.size() == 16384 && r.size() == 3 && q.back() == 1);
+    const int src[2] = {8, 9};
+    std::vector<edit_op<const int*> > edits;
+    edits.push_back(make_edit(0, 1, src, src + 2));
+    thrown = false;
+    try {
+        q.apply_edits(edits.begin(), edits.end());
+    } catch (std::overflow_error&) {
+        thrown = true;
+    }
+    GUNUNU_CHECK(thrown && q.size() == 16384 && q.front() == 1 && q[8] == 2);
+
+    q.erase(q.begin(), q.begin() + 3);
+    q.splice(q.end(), r, r.begin(), r.end());
+    GUNUNU_CHECK(q.size() == 16384 && r.empty() && q.back() == 7 && q[2] == 2 && q[6] == 1);
+}
+
 #ifndef GUNUNU_TEST 
 int main()
 #else
@@ -296,6 +752,17 @@ int test_anywhere_deque()
     ad_swap(mt);
     ad_pop_back(mt);
     ad_pop_front(mt);
+    ad_split_concat(mt);
+    ad_splice(mt);
+    ad_reverse_rotate(mt);
+    ad_node_walking_algorithm(mt);
+    ad_weighted_algorithm(mt);
+    ad_construct_resize(mt);
+    ad_weighted(mt);
+    ad_gap(mt);
+    ad_apply_edits(mt);
+    ad_sort(mt);
+    ad_narrow_keys();
     cout << "passed: test_anywhere_deque\n";
     return 0;
 }
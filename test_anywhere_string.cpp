@@ -0,0 +1,137 @@
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include <chrono>
+#include <boost/random.hpp>
+#include "anywhere_string.hpp"
+using namespace std;
+using namespace gununu;
+
+#ifndef GUNUNU_CHECK
+#define GUNUNU_CHECK(ex) do {if (!(ex)) {cout << "check fail at: " << __func__ << " file: \"" << __FILE__ << "\" line:" << __LINE__ << " error:" << #ex << endl; abort();} } while(false)
+#endif
+
+typedef anywhere_string<std::allocator<char>, 16> small_string;
+
+string as_random_text(boost::random::mt19937& mt, size_t n) {
+    static const char letters[] = "ab\n";
+    boost::random::uniform_int_distribution<> ud(0, 2);
+    string s;
+    for (size_t i=0; i<n; ++i)
+        s += letters[ud(mt)];
+    return s;
+}
+
+void as_interface() {
+    anywhere_string<> s("hello\nworld");
+    GUNUNU_CHECK(s.size() == 11);
+    GUNUNU_CHECK(s.str() == "hello\nworld");
+    GUNUNU_CHECK(s[6] == 'w');
+    GUNUNU_CHECK(s.line_count() == 2);
+    GUNUNU_CHECK(s.line_of(6) == 1);
+    GUNUNU_CHECK(s.line_begin(1) == 6);
+    GUNUNU_CHECK(s.column_of(8) == 2);
+    s.insert(5, ", dear");
+    GUNUNU_CHECK(s.str() == "hello, dear\nworld");
+    s.erase(0, 7);
+    GUNUNU_CHECK(s.str() == "dear\nworld");
+    s += '!';
+    GUNUNU_CHECK(s.find("world") == 5);
+    GUNUNU_CHECK(s.find('!') == 10);
+    GUNUNU_CHECK(s.find("worlds") == anywhere_string<>::npos);
+    GUNUNU_CHECK(string(s.begin(), s.end()) == "dear\nworld!");
+    GUNUNU_CHECK(s.substr(2, 4) == "ar\nw");
+    s.clear();
+    GUNUNU_CHECK(s.empty() && s.line_count() == 1);
+}
+
+void as_random_edit(boost::random::mt19937& mt) {
+    small_string s;
+    string v;
+    for (int i=0; i<1000; ++i) {
+        boost::random::uniform_int_distribution<> op(0, 3);
+        boost::random::uniform_int_distribution<size_t> pos(0, v.size());
+        boost::random::uniform_int_distribution<size_t> len(0, 40);
+        size_t p = pos(mt);
+        if (op(mt) == 0) {
+            size_t n = len(mt);
+            s.erase(p, n);
+            v.erase(p, n);
+        } else {
+            string t = as_random_text(mt, len(mt));
+            s.insert(p, t);
+            v.insert(p, t);
+        }
+        GUNUNU_CHECK(s.size() == v.size());
+        GUNUNU_CHECK(s.str() == v);
+        GUNUNU_CHECK(s.line_count() == (size_t)std::count(v.begin(), v.end(), '\n') + 1);
+    }
+}
+
+void as_search(boost::random::mt19937& mt) {
+    string v = as_random_text(mt, 3000);
+    small_string s(v);
+    for (int i=0; i<300; ++i) {
+        boost::random::uniform_int_distribution<size_t> pos(0, v.size());
+        boost::random::uniform_int_distribution<size_t> len(1, 8);
+        size_t p = pos(mt);
+        string t = as_random_text(mt, len(mt));
+        GUNUNU_CHECK(s.find(t, p) == v.find(t, p));
+        GUNUNU_CHECK(s.find(t[0], p) == v.find(t[0], p));
+        size_t q = pos(mt);
+        if (q < p)
+            std::swap(p, q);
+        GUNUNU_CHECK(s.count('a', p, q-p) == (size_t)std::count(v.begin()+p, v.begin()+q, 'a'));
+        GUNUNU_CHECK(s.count('\n', p, q-p) == (size_t)std::count(v.begin()+p, v.begin()+q, '\n'));
+        GUNUNU_CHECK(gununu::find(s.begin()+p, s.end(), 'b') - s.begin() == (std::ptrdiff_t)std::min(v.find('b', p), v.size()));
+        string u;
+        gununu::for_each(s.begin()+p, s.begin()+q, [&u](char c) { u += c; });
+        GUNUNU_CHECK(u == v.substr(p, q-p));
+    }
+    bool thrown = false;
+    try {
+        s.count('a', s.size() + 1);
+    } catch (std::out_of_range&) {
+        thrown = true;
+    }
+    GUNUNU_CHECK(thrown);
+}
+
+void as_lines(boost::random::mt19937& mt) {
+    small_string s;
+    string v;
+    for (int i=0; i<100; ++i) {
+        string t = as_random_text(mt, 30);
+        s.append(t);
+        v += t;
+        size_t line = 0, begin = 0;
+        for (size_t j=0; j<=v.size(); ++j) {
+            GUNUNU_CHECK(s.line_of(j) == line);
+            GUNUNU_CHECK(s.column_of(j) == j - begin);
+            if (j < v.size() && v[j] == '\n') {
+                ++line;
+                begin = j + 1;
+                GUNUNU_CHECK(s.line_begin(line) == begin);
+            }
+        }
+        GUNUNU_CHECK(s.line_begin(line + 1) == small_string::npos);
+    }
+}
+
+#ifndef GUNUNU_TEST
+int main()
+#else
+int test_anywhere_string()
+#endif
+
+{
+    cout << "testing: test_anywhere_string\n";
+    boost::random::mt19937 mt;
+    mt.seed(std::chrono::system_clock::now().time_since_epoch().count());
+    as_interface();
+    as_random_edit(mt);
+    as_search(mt);
+    as_lines(mt);
+    cout << "passed: test_anywhere_string\n";
+    return 0;
+}
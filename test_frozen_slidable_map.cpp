@@ -0,0 +1,92 @@
+#include <iostream>
+#include <map>
+#include <string>
+#include <chrono>
+#include <boost/random.hpp>
+#include "frozen_slidable_map.hpp"
+using namespace std;
+using namespace gununu;
+
+#ifndef GUNUNU_CHECK
+#define GUNUNU_CHECK(ex) do {if (!(ex)) {cout << "check fail at: " << __func__ << " file: \"" << __FILE__ << "\" line:" << __LINE__ << " error:" << #ex << endl; abort();} } while(false)
+#endif
+
+template <class It, class RefIt>
+bool fsm_same(It a, It aend, RefIt b, RefIt bend) {
+    return (a == aend) == (b == bend) && (b == bend || (a->first() == b->first && a->second() == b->second));
+}
+
+void fsm_interface() {
+    slidable_map<int, int, string> m;
+    frozen_slidable_map<int, int, string> e = m.freeze();
+    GUNUNU_CHECK(e.empty() && e.begin() == e.end() && e.lower_bound(0) == e.end());
+    m[0] = "a";
+    m[10] = "b";
+    m[20] = "c";
+    frozen_slidable_map<int, int, string> f = m.freeze();
+    GUNUNU_CHECK(f.size() == 3 && f.find(10)->second() == "b" && f.find(11) == f.end());
+    f.slide_all(5);
+    GUNUNU_CHECK(f.begin()->first() == 5 && f.lower_bound(16)->first() == 25 && f.upper_bound(25) == f.end());
+    GUNUNU_CHECK((--f.end())->second() == "c");
+    slidable_map<int, int, string> t = f.thaw();
+    GUNUNU_CHECK(t.check_structure() && t.size() == 3 && t.find(15)->second() == "b");
+}
+
+void fsm_random(boost::random::mt19937& mt) {
+    boost::random::uniform_int_distribution<> key(-1000, 1000);
+    for (int n=0; n<200; ++n) {
+        slidable_map<int, int, int> m;
+        std::map<int, int> r;
+        for (int i=0; i<n; ++i) {
+            int k = key(mt);
+            m[k] = i;
+            r[k] = i;
+        }
+        frozen_slidable_map<int, int, int> f = m.freeze();
+        const int qty = key(mt);
+        f.slide_all(qty);
+        std::map<int, int> s;
+        for (std::map<int, int>::iterator p = r.begin(); p != r.end(); ++p)
+            s.insert(make_pair(p->first + qty, p->second));
+
+        GUNUNU_CHECK(f.size() == s.size());
+        frozen_slidable_map<int, int, int>::const_iterator it = f.begin();
+        for (std::map<int, int>::iterator p = s.begin(); p != s.end(); ++p, ++it)
+            GUNUNU_CHECK(fsm_same(it, f.end(), p, s.end()));
+        GUNUNU_CHECK(it == f.end());
+        for (std::map<int, int>::reverse_iterator p = s.rbegin(); p != s.rend(); ++p)
+            GUNUNU_CHECK((--it)->first() == p->first);
+
+        for (int i=0; i<100; ++i) {
+            int k = key(mt) * 2;
+            GUNUNU_CHECK(fsm_same(f.lower_bound(k), f.end(), s.lower_bound(k), s.end()));
+            GUNUNU_CHECK(fsm_same(f.upper_bound(k), f.end(), s.upper_bound(k), s.end()));
+            GUNUNU_CHECK(f.count(k) == s.count(k));
+        }
+
+        slidable_map<int, int, int> t = f.thaw();
+        GUNUNU_CHECK(t.check_structure() && t.size() == s.size());
+        slidable_map<int, int, int>::iterator q = t.begin();
+        for (std::map<int, int>::iterator p = s.begin(); p != s.end(); ++p, ++q)
+            GUNUNU_CHECK(q->first() == p->first && q->second() == p->second);
+        t.insert(make_pair(5000, 0));
+        t.slide_rightkeys(0, 3);
+        GUNUNU_CHECK(t.check_structure());
+    }
+}
+
+#ifndef GUNUNU_TEST
+int main()
+#else
+int test_frozen_slidable_map()
+#endif
+
+{
+    cout << "testing: test_frozen_slidable_map\n";
+    boost::random::mt19937 mt;
+    mt.seed(std::chrono::system_clock::now().time_since_epoch().count());
+    fsm_interface();
+    fsm_random(mt);
+    cout << "passed: test_frozen_slidable_map\n";
+    return 0;
+}
@@ -0,0 +1,149 @@
+#include <iostream>
+#include <map>
+#include <string>
+#include <chrono>
+#include <boost/random.hpp>
+#include "slidable_flat_map.hpp"
+using namespace std;
+using namespace gununu;
+
+#ifndef GUNUNU_CHECK
+#define GUNUNU_CHECK(ex) do {if (!(ex)) {cout << "check fail at: " << __func__ << " file: \"" << __FILE__ << "\" line:" << __LINE__ << " error:" << #ex << endl; abort();} } while(false)
+#endif
+
+template <class Map, class Ref>
+bool sfm_equal(const Map& m, const Ref& r) {
+    if (m.size() != r.size())
+        return false;
+    typename Map::const_iterator it = m.begin();
+    for (typename Ref::const_iterator p = r.begin(); p != r.end(); ++p, ++it)
+        if (it->first() != p->first || it->second() != p->second)
+            return false;
+    return it == m.end();
+}
+
+template <class It, class RefIt>
+bool sfm_same(It a, It aend, RefIt b, RefIt bend) {
+    return (a == aend) == (b == bend) && (b == bend || (a->first() == b->first && a->second() == b->second));
+}
+
+void sfm_interface() {
+    slidable_flat_map<int, int, string> m;
+    m[0] = "a";
+    m[10] = "b";
+    m[20] = "c";
+    m.slide_rightkeys(10, 5);
+    GUNUNU_CHECK(m.find(15)->second() == "b" && m.find(10) == m.end() && m.lower_bound(11)->first() == 15);
+    m.slide_leftkeys(15, -5);
+    GUNUNU_CHECK(m.at(-5) == "a" && m.at(10) == "b" && m.upper_bound(10)->first() == 25);
+    m.slide_all(5);
+    GUNUNU_CHECK(m.begin()->first() == 0 && (--m.end())->first() == 30);
+    m.insert(make_pair(5, string("d")));
+    GUNUNU_CHECK(m.erase(15) == 1 && m.size() == 3);
+    GUNUNU_CHECK(m.erase(m.begin())->second() == "d");
+
+    // the rest of the slidable_map interface. the keys are 5 and 30 here
+    m.insert_by(m.find(5), 8, "e");
+    GUNUNU_CHECK(m.rbegin()->first() == 30 && (++m.rbegin())->second() == "e" && (--m.rend())->first() == 5);
+    GUNUNU_CHECK(m.equal_range(13).first->second() == "e" && m.equal_range(14).first == m.end());
+    GUNUNU_CHECK(m.rlower_bound(29)->first() == 13 && m.rupper_bound(13)->first() == 5 && m.rupper_bound(5) == m.end());
+    GUNUNU_CHECK(m.lower_bound2(11).second == 13 && m.rlower_bound2(31).second == 30);
+    m.movekey(m.find(13), 10);
+    GUNUNU_CHECK(m.find(23)->second() == "e" && m.find(13) == m.end());
+    slidable_flat_map<int, int, string>::iterator last = m.erase(m.find(23), m.end());
+    GUNUNU_CHECK(last == m.end() && m.size() == 1);
+    const slidable_flat_map<int, int, string>& c = m;
+    GUNUNU_CHECK(c.rbegin()->second() == "d" && ++c.rbegin() == c.rend());
+}
+
+void sfm_random(boost::random::mt19937& mt) {
+    boost::random::uniform_int_distribution<> key(-300, 300);
+    boost::random::uniform_int_distribution<> op(0, 10);
+    for (int n=0; n<50; ++n) {
+        slidable_flat_map<int, int, int> m;
+        std::map<int, int> r;
+        for (int i=0; i<2000; ++i) {
+            int k = key(mt);
+            std::map<int, int> t;
+            switch (op(mt)) {
+            case 0:
+            case 1:
+                GUNUNU_CHECK(m.insert(make_pair(k, i)).second == r.insert(make_pair(k, i)).second);
+                break;
+            case 2:
+                GUNUNU_CHECK(m.erase(k) == r.erase(k));
+                break;
+            case 3:
+                m.slide_rightkeys(k, 5);
+                for (std::map<int, int>::iterator p = r.begin(); p != r.end(); ++p)
+                    t.insert(make_pair(p->first < k ? p->first : p->first + 5, p->second));
+                r.swap(t);
+                break;
+            case 4:
+                m.slide_leftkeys(k, -5);
+                for (std::map<int, int>::iterator p = r.begin(); p != r.end(); ++p)
+                    t.insert(make_pair(k < p->first ? p->first : p->first - 5, p->second));
+                r.swap(t);
+                break;
+            case 5:
+                m.slide_all(k % 4);
+                for (std::map<int, int>::iterator p = r.begin(); p != r.end(); ++p)
+                    t.insert(make_pair(p->first + k % 4, p->second));
+                r.swap(t);
+                break;
+            case 6:
+                GUNUNU_CHECK(sfm_same(m.lower_bound(k), m.end(), r.lower_bound(k), r.end()));
+                GUNUNU_CHECK(sfm_same(m.upper_bound(k), m.end(), r.upper_bound(k), r.end()));
+                GUNUNU_CHECK(m.count(k) == r.count(k));
+                break;
+            case 7:
+                if (m.lower_bound(k) != m.end()) {
+                    m.erase(m.lower_bound(k));
+                    r.erase(r.lower_bound(k));
+                }
+                break;
+            case 8: {
+                std::map<int, int>::iterator p = r.upper_bound(k);
+                GUNUNU_CHECK(sfm_same(m.rlower_bound(k), m.end(), p == r.begin() ? r.end() : prev(p), r.end()));
+                p = r.lower_bound(k);
+                GUNUNU_CHECK(sfm_same(m.rupper_bound(k), m.end(), p == r.begin() ? r.end() : prev(p), r.end()));
+                GUNUNU_CHECK(m.lower_bound2(k).second == (p == r.end() ? 0 : p->first));
+                break;
+            }
+            case 9: {
+                // moves one key by 1 where its neighbour leaves room, or erases a range
+                std::map<int, int>::iterator p = r.lower_bound(k);
+                if (p != r.end() && (next(p) == r.end() || p->first + 1 < next(p)->first)) {
+                    m.movekey(m.lower_bound(k), 1);
+                    r.insert(make_pair(p->first + 1, p->second));
+                    r.erase(p);
+                } else {
+                    m.erase(m.lower_bound(k), m.upper_bound(k + 20));
+                    r.erase(r.lower_bound(k), r.upper_bound(k + 20));
+                }
+                break;
+            }
+            default:
+                if (i % 20 == 0)
+                    GUNUNU_CHECK(sfm_equal(m, r));
+            }
+        }
+        GUNUNU_CHECK(sfm_equal(m, r));
+    }
+}
+
+#ifndef GUNUNU_TEST
+int main()
+#else
+int test_slidable_flat_map()
+#endif
+
+{
+    cout << "testing: test_slidable_flat_map\n";
+    boost::random::mt19937 mt;
+    mt.seed(std::chrono::system_clock::now().time_since_epoch().count());
+    sfm_interface();
+    sfm_random(mt);
+    cout << "passed: test_slidable_flat_map\n";
+    return 0;
+}
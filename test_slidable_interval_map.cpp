@@ -0,0 +1,197 @@
+#include <iostream>
+#include <map>
+#include <vector>
+#include <iterator>
+#include <chrono>
+#include <boost/random.hpp>
+#include <boost/static_assert.hpp>
+#include <boost/type_traits/is_same.hpp>
+#include "slidable_interval_map.hpp"
+using namespace std;
+using namespace gununu;
+
+#ifndef GUNUNU_CHECK
+#define GUNUNU_CHECK(ex) do {if (!(ex)) {cout << "check fail at: " << __func__ << " file: \"" << __FILE__ << "\" line:" << __LINE__ << " error:" << #ex << endl; abort();} } while(false)
+#endif
+
+typedef slidable_interval_map<int, int, int> sim_map;
+// start -> (length, value)
+typedef std::map<int, std::pair<int, int> > sim_ref;
+
+// the starts of the intervals of r which start before hi and end after lo (contain lo if closed)
+std::vector<int> sim_expected(const sim_ref& r, int lo, int hi, bool closed) {
+    std::vector<int> ret;
+    for (sim_ref::const_iterator p = r.begin(); p != r.end(); ++p) {
+        const int end = p->first + p->second.first;
+        if (closed ? (p->first <= lo && lo < end) : (lo < hi && p->first < hi && lo < end))
+            ret.push_back(p->first);
+    }
+    return ret;
+}
+
+template <class It>
+std::vector<int> sim_starts(const std::vector<It>& found) {
+    std::vector<int> ret;
+    for (std::size_t i=0; i<found.size(); ++i) {
+        It it = found[i];
+        ret.push_back(it->first());
+    }
+    return ret;
+}
+
+// an output iterator which accepts only It, so that the type of the written iterators is checked
+template <class It>
+struct sim_only {
+    explicit sim_only(std::vector<It>& v) : v(&v) {}
+    template <class U>
+    sim_only& operator = (const U& it) {
+        BOOST_STATIC_ASSERT((boost::is_same<U, It>::value));
+        v->push_back(it);
+        return *this;
+    }
+    sim_only& operator * () { return *this; }
+    sim_only& operator ++ () { return *this; }
+    std::vector<It>* v;
+};
+
+bool sim_equal(const sim_map& m, const sim_ref& r) {
+    if (m.size() != r.size())
+        return false;
+    sim_map::const_iterator it = m.begin();
+    for (sim_ref::const_iterator p = r.begin(); p != r.end(); ++p, ++it)
+        if (it->first() != p->first || it->second().length != p->second.first || it->second().value != p->second.second)
+            return false;
+    return it == m.end();
+}
+
+void sim_interface() {
+    sim_map m;
+    GUNUNU_CHECK(m.insert(0, 10, 1).second);
+    GUNUNU_CHECK(m.insert(5, 7, 2).second);
+    GUNUNU_CHECK(m.insert(20, 30, 3).second);
+    GUNUNU_CHECK(!m.insert(5, 100, 4).second);
+    GUNUNU_CHECK(m.find(5)->second().length == 2);
+
+    std::vector<sim_map::iterator> found;
+    m.overlapping(6, 21, std::back_inserter(found));
+    GUNUNU_CHECK(found.size() == 3 && found[0]->second().value == 1 && found[2]->first() == 20);
+    found.clear();
+    m.at(7, std::back_inserter(found));
+    GUNUNU_CHECK(found.size() == 1 && found[0]->first() == 0);
+    found.clear();
+    m.overlapping(10, 20, std::back_inserter(found));
+    GUNUNU_CHECK(found.empty());
+
+    // the intervals which start at 5 or after move, [0,10) keeps its end
+    m.slide_rightkeys(5, 100);
+    found.clear();
+    m.at(7, std::back_inserter(found));
+    GUNUNU_CHECK(found.size() == 1 && found[0]->first() == 0);
+    found.clear();
+    m.at(106, std::back_inserter(found));
+    GUNUNU_CHECK(found.size() == 1 && found[0]->second().value == 2);
+    m.slide_all(-100);
+    found.clear();
+    m.at(20, std::back_inserter(found));
+    GUNUNU_CHECK(found.size() == 1 && found[0]->first() == 20);
+
+    const sim_map& c = m;
+    std::vector<sim_map::const_iterator> cfound;
+    c.overlapping(-1000, 1000, sim_only<sim_map::const_iterator>(cfound));
+    GUNUNU_CHECK(cfound.size() == 3 && cfound[0] == c.begin());
+    c.at(20, sim_only<sim_map::const_iterator>(cfound));
+    GUNUNU_CHECK(cfound.size() == 4 && cfound[3]->first() == 20);
+    found.clear();
+    m.overlapping(-1000, 1000, sim_only<sim_map::iterator>(found));
+    m.at(20, sim_only<sim_map::iterator>(found));
+    GUNUNU_CHECK(found.size() == 4 && found[3]->first() == 20);
+    GUNUNU_CHECK(m.erase(-100) == 1 && m.erase(-100) == 0 && m.size() == 2);
+}
+
+void sim_random(boost::random::mt19937& mt) {
+    boost::random::uniform_int_distribution<> key(-300, 300);
+    boost::random::uniform_int_distribution<> length(0, 40);
+    boost::random::uniform_int_distribution<> qty(-5, 5);
+    boost::random::uniform_int_distribution<> op(0, 7);
+    for (int n=0; n<50; ++n) {
+        sim_map m;
+        sim_ref r;
+        for (int i=0; i<1000; ++i) {
+            int k = key(mt);
+            int q = qty(mt);
+            sim_ref t;
+            switch (op(mt)) {
+            case 0:
+            case 1: {
+                int l = (i % 50 == 0) ? length(mt) * 10 : length(mt);
+                GUNUNU_CHECK(m.insert(k, k + l, i).second == r.insert(std::make_pair(k, std::make_pair(l, i))).second);
+                break;
+            }
+            case 2:
+                GUNUNU_CHECK(m.erase(k) == r.erase(k));
+                break;
+            case 3:
+                if (q < 0 && r.lower_bound(k) != r.begin() && r.lower_bound(k) != r.end()
+                    && r.lower_bound(k)->first + q <= prev(r.lower_bound(k))->first)
+                    break;
+                m.slide_rightkeys(k, q);
+                for (sim_ref::iterator p = r.begin(); p != r.end(); ++p)
+                    t.insert(std::make_pair(p->first < k ? p->first : p->first + q, p->second));
+                r.swap(t);
+                break;
+            case 4:
+                if (0 < q && r.upper_bound(k) != r.begin() && r.upper_bound(k) != r.end()
+                    && r.upper_bound(k)->first <= prev(r.upper_bound(k))->first + q)
+                    break;
+                m.slide_leftkeys(k, q);
+                for (sim_ref::iterator p = r.begin(); p != r.end(); ++p)
+                    t.insert(std::make_pair(k < p->first ? p->first : p->first + q, p->second));
+                r.swap(t);
+                break;
+            case 5:
+                m.slide_all(q);
+                for (sim_ref::iterator p = r.begin(); p != r.end(); ++p)
+                    t.insert(std::make_pair(p->first + q, p->second));
+                r.swap(t);
+                break;
+            case 6:
+                if (m.lower_bound(k) != m.end()) {
+                    m.erase(m.lower_bound(k));
+                    r.erase(r.lower_bound(k));
+                }
+                break;
+            default: {
+                sim_map c(m);
+                m.clear();
+                m.swap(c);
+            }
+            }
+            GUNUNU_CHECK(m.check_structure());
+            int lo = key(mt);
+            int hi = lo + length(mt);
+            std::vector<sim_map::iterator> found;
+            m.overlapping(lo, hi, std::back_inserter(found));
+            GUNUNU_CHECK(sim_starts(found) == sim_expected(r, lo, hi, false));
+            found.clear();
+            m.at(lo, std::back_inserter(found));
+            GUNUNU_CHECK(sim_starts(found) == sim_expected(r, lo, lo, true));
+        }
+        GUNUNU_CHECK(sim_equal(m, r));
+    }
+}
+
+#ifndef GUNUNU_TEST
+int main()
+#else
+int test_slidable_interval_map()
+#endif
+
+{
+    cout << "testing: test_slidable_interval_map\n";
+    boost::random::mt19937 mt;
+    mt.seed(std::chrono::system_clock::now().time_since_epoch().count());
+    sim_interface();
+    sim_random(mt);
+    cout << "passed: test_slidable_interval_map\n";
+    return 0;
+}
@@ -0,0 +1,720 @@
+#include <iostream>
+#include <map>
+#include <vector>
+#include <string>
+#include <iterator>
+#include <chrono>
+#include <new>
+#include <boost/random.hpp>
+#include "slidable_map.hpp"
+using namespace std;
+using namespace gununu;
+
+#ifndef GUNUNU_CHECK
+#define GUNUNU_CHECK(ex) do {if (!(ex)) {cout << "check fail at: " << __func__ << " file: \"" << __FILE__ << "\" line:" << __LINE__ << " error:" << #ex << endl; abort();} } while(false)
+#endif
+
+template <class Map, class Ref>
+bool sm_equal(const Map& m, const Ref& r) {
+    if (m.size() != r.size())
+        return false;
+    typename Map::const_iterator it = m.begin();
+    for (typename Ref::const_iterator p = r.begin(); p != r.end(); ++p, ++it)
+        if (it->first() != p->first || it->second() != p->second)
+            return false;
+    return true;
+}
+
+void sm_scale_keys(boost::random::mt19937& mt) {
+    typedef slidable_map<long long, long long, int, std::allocator<std::pair<const long long, int> >, key_scaling<long long> > map_type;
+    boost::random::uniform_int_distribution<long long> key(-1000, 1000);
+    boost::random::uniform_int_distribution<long long> factor(1, 3);
+    boost::random::uniform_int_distribution<> op(0, 3);
+    for (int n=0; n<50; ++n) {
+        map_type m;
+        std::map<long long, int> r;
+        for (int i=0; i<200; ++i) {
+            long long k = key(mt);
+            m.insert(std::make_pair(k, i));
+            r.insert(std::make_pair(k, i));
+        }
+        for (int i=0; i<20; ++i) {
+            long long lo = key(mt), hi = key(mt), f = factor(mt);
+            if (hi < lo)
+                std::swap(lo, hi);
+            std::map<long long, int> t;
+            switch (op(mt)) {
+            case 0:
+                m.scale_rightkeys(lo, f);
+                for (std::map<long long, int>::iterator p = r.begin(); p != r.end(); ++p)
+                    t.insert(std::make_pair(p->first < lo ? p->first : lo + (p->first - lo) * f, p->second));
+                break;
+            case 1:
+                m.scale_range(lo, hi, f);
+                for (std::map<long long, int>::iterator p = r.begin(); p != r.end(); ++p) {
+                    long long k = p->first;
+                    if (hi <= k)
+                        k += (hi - lo) * (f - 1);
+                    else if (lo <= k)
+                        k = lo + (k - lo) * f;
+                    t.insert(std::make_pair(k, p->second));
+                }
+                break;
+            case 2:
+                if (r.lower_bound(lo) != r.end()) {
+                    m.erase(m.lower_bound(lo));
+                    r.erase(r.lower_bound(lo));
+                }
+                t = r;
+                break;
+            default:
+                m.slide_rightkeys(lo, 1);
+                for (std::map<long long, int>::iterator p = r.begin(); p != r.end(); ++p)
+                    t.insert(std::make_pair(p->first < lo ? p->first : p->first + 1, p->second));
+                m.insert(std::make_pair(lo, -i));
+                t.insert(std::make_pair(lo, -i));
+            }
+            r.swap(t);
+            GUNUNU_CHECK(sm_equal(m, r));
+            GUNUNU_CHECK(m.find(r.begin()->first)->second() == r.begin()->second);
+        }
+    }
+}
+
+void sm_time_stretch() {
+    slidable_map<double, double, int, std::allocator<std::pair<const double, int> >, key_scaling<> > m;
+    for (int i=0; i<10; ++i)
+        m.insert(std::make_pair(double(i), i));
+    m.scale_range(2.0, 6.0, 0.5);
+    const double expect[] = {0, 1, 2, 2.5, 3, 3.5, 4, 5, 6, 7};
+    int i = 0;
+    for (auto it = m.begin(); it != m.end(); ++it, ++i)
+        GUNUNU_CHECK(it->first() == expect[i] && it->second() == i);
+}
+
+struct sm_add {
+    sm_add() : n(0) {}
+    explicit sm_add(int x) : n(x) {}
+    void operator () (int& v) const { v += n; }
+    void then(const sm_add& next) { n += next.n; }
+    int n;
+};
+
+void sm_update_range(boost::random::mt19937& mt) {
+    typedef slidable_map<int, int, int, std::allocator<std::pair<const int, int> >, lazy_update<sm_add> > map_type;
+    boost::random::uniform_int_distribution<> key(-500, 500);
+    boost::random::uniform_int_distribution<> op(0, 4);
+    for (int n=0; n<50; ++n) {
+        map_type m;
+        std::map<int, int> r;
+        for (int i=0; i<300; ++i) {
+            int lo = key(mt), hi = key(mt);
+            if (hi < lo)
+                std::swap(lo, hi);
+            switch (op(mt)) {
+            case 0:
+            case 1:
+                m.update_range(lo, hi, sm_add(i));
+                for (std::map<int, int>::iterator p = r.lower_bound(lo); p != r.lower_bound(hi); ++p)
+                    p->second += i;
+                break;
+            case 2:
+                m.insert(std::make_pair(lo, i));
+                r.insert(std::make_pair(lo, i));
+                break;
+            case 3:
+                if (r.find(lo) != r.end()) {
+                    GUNUNU_CHECK(m.find(lo)->second() == r[lo]);
+                    m.erase(lo);
+                    r.erase(lo);
+                }
+                break;
+            default: {
+                map_type c(m);
+                GUNUNU_CHECK(sm_equal(c, r));
+            }
+            }
+        }
+        GUNUNU_CHECK(sm_equal(m, r));
+    }
+}
+
+void sm_finger_search(boost::random::mt19937& mt) {
+    typedef slidable_map<int, int, int, std::allocator<std::pair<const int, int> >, detail::no_augment, finger_search> map_type;
+    boost::random::uniform_int_distribution<> key(-300, 300);
+    boost::random::uniform_int_distribution<> step(-5, 5);
+    boost::random::uniform_int_distribution<> op(0, 6);
+    for (int n=0; n<50; ++n) {
+        map_type m;
+        std::map<int, int> r;
+        int k = 0;
+        for (int i=0; i<1000; ++i) {
+            k += step(mt);
+            std::map<int, int>::iterator p = r.lower_bound(k);
+            switch (op(mt)) {
+            case 0:
+            case 1:
+                m.insert(std::make_pair(k, i));
+                r.insert(std::make_pair(k, i));
+                break;
+            case 2:
+                GUNUNU_CHECK(m.erase(k) == r.erase(k));
+                break;
+            case 3: {
+                // const searches start from the finger without moving it
+                const map_type& c = m;
+                GUNUNU_CHECK((m.find(k) == m.end()) == (r.find(k) == r.end()));
+                GUNUNU_CHECK((c.find(k + 1) == c.end()) == (r.find(k + 1) == r.end()));
+                GUNUNU_CHECK((c.lower_bound(k) == c.end()) == (p == r.end()));
+                if (p != r.end())
+                    GUNUNU_CHECK(c.lower_bound2(k).second == p->first);
+                GUNUNU_CHECK((c.equal_range(k).first == c.equal_range(k).second) == (r.find(k) == r.end()));
+                break;
+            }
+            case 4:
+                GUNUNU_CHECK((m.lower_bound(k) == m.end()) == (p == r.end()));
+                if (p != r.end())
+                    GUNUNU_CHECK(m.lower_bound(k)->first() == p->first);
+                break;
+            case 5:
+                GUNUNU_CHECK((m.rupper_bound(k) == m.end()) == (p == r.begin()));
+                if (p != r.begin())
+                    GUNUNU_CHECK(m.rupper_bound(k)->first() == (--p)->first);
+                break;
+            default: {
+                m.slide_rightkeys(k, 1);
+                std::map<int, int> t;
+                for (p = r.begin(); p != r.end(); ++p)
+                    t.insert(std::make_pair(p->first < k ? p->first : p->first + 1, p->second));
+                r.swap(t);
+                k = key(mt);
+            }
+            }
+        }
+        GUNUNU_CHECK(m.check_structure());
+        GUNUNU_CHECK(sm_equal(m, r));
+    }
+}
+
+void sm_threaded(boost::random::mt19937& mt) {
+    typedef slidable_map<int, int, int, std::allocator<std::pair<const int, int> >, detail::no_augment, root_search, threaded> map_type;
+    boost::random::uniform_int_distribution<> key(-300, 300);
+    boost::random::uniform_int_distribution<> op(0, 5);
+    for (int n=0; n<50; ++n) {
+        map_type m;
+        std::map<int, int> r;
+        for (int i=0; i<300; ++i) {
+            int k = key(mt);
+            switch (op(mt)) {
+            case 0:
+            case 1:
+                m.insert(std::make_pair(k, i));
+                r.insert(std::make_pair(k, i));
+                break;
+            case 2:
+                GUNUNU_CHECK(m.erase(k) == r.erase(k));
+                break;
+            case 3: {
+                map_type c(m);
+                m.clear();
+                m = c;
+                break;
+            }
+            case 4:
+                m.slide_rightkeys(k, 2);
+                {
+                    std::map<int, int> t;
+                    for (std::map<int, int>::iterator p = r.begin(); p != r.end(); ++p)
+                        t.insert(std::make_pair(p->first < k ? p->first : p->first + 2, p->second));
+                    r.swap(t);
+                }
+                break;
+            default:
+                if (m.lower_bound(k) != m.end()) {
+                    r.erase(m.lower_bound(k)->first());
+                    m.erase(m.lower_bound(k));
+                }
+            }
+            GUNUNU_CHECK(sm_equal(m, r));
+            std::map<int, int>::const_reverse_iterator p = r.rbegin();
+            for (map_type::const_reverse_iterator it = m.crbegin(); it != m.crend(); ++it, ++p)
+                GUNUNU_CHECK(it->first() == p->first);
+        }
+        GUNUNU_CHECK(m.check_structure());
+    }
+}
+
+void sm_find_many(boost::random::mt19937& mt) {
+    typedef slidable_map<int, int, int> map_type;
+    boost::random::uniform_int_distribution<> key(-1000, 1000);
+    for (int n=0; n<50; ++n) {
+        map_type m;
+        for (int i=0; i<n*20; ++i)
+            m.insert(std::make_pair(key(mt), i));
+        std::vector<int> keys;
+        for (int i=0; i<100; ++i)
+            keys.push_back(key(mt));
+        std::vector<map_type::iterator> found, bound;
+        m.find_many(keys.begin(), keys.end(), std::back_inserter(found));
+        m.lower_bound_many(keys.begin(), keys.end(), std::back_inserter(bound));
+        GUNUNU_CHECK(found.size() == keys.size() && bound.size() == keys.size());
+        for (size_t i=0; i<keys.size(); ++i) {
+            GUNUNU_CHECK(found[i] == m.find(keys[i]));
+            GUNUNU_CHECK(bound[i] == m.lower_bound(keys[i]));
+        }
+    }
+}
+
+void sm_compact(boost::random::mt19937& mt) {
+    typedef slidable_map<long long, long long, std::string, std::allocator<std::pair<const long long, std::string> >, key_scaling<long long>, root_search, threaded> map_type;
+    boost::random::uniform_int_distribution<long long> key(-1000, 1000);
+    for (int n=0; n<50; ++n) {
+        map_type m;
+        std::map<long long, std::string> r;
+        for (int i=0; i<n*10; ++i) {
+            long long k = key(mt);
+            m.insert(std::make_pair(k, std::string(i, 'a')));
+            r.insert(std::make_pair(k, std::string(i, 'a')));
+            if (i % 3 == 0) {
+                m.erase(k);
+                r.erase(k);
+            }
+        }
+        m.scale_rightkeys(0, 2);
+        std::map<long long, std::string> t;
+        for (std::map<long long, std::string>::iterator p = r.begin(); p != r.end(); ++p)
+            t.insert(std::make_pair(p->first < 0 ? p->first : p->first * 2, p->second));
+        r.swap(t);
+        m.compact();
+        GUNUNU_CHECK(m.check_structure());
+        GUNUNU_CHECK(sm_equal(m, r));
+        std::map<long long, std::string>::const_reverse_iterator p = r.rbegin();
+        for (map_type::const_reverse_iterator it = m.crbegin(); it != m.crend(); ++it, ++p)
+            GUNUNU_CHECK(it->first() == p->first);
+        if (!r.empty())
+            GUNUNU_CHECK(m.find(r.begin()->first)->second() == r.begin()->second);
+    }
+}
+
+void sm_separate_values(boost::random::mt19937& mt) {
+    typedef slidable_map<int, int, std::string, std::allocator<std::pair<const int, std::string> >, detail::no_augment, finger_search, unthreaded, separate_values> map_type;
+    boost::random::uniform_int_distribution<> key(-300, 300);
+    boost::random::uniform_int_distribution<> op(0, 5);
+    for (int n=0; n<50; ++n) {
+        map_type m;
+        std::map<int, std::string> r;
+        for (int i=0; i<300; ++i) {
+            int k = key(mt);
+            std::string v(i % 40, 'a' + i % 26);
+            switch (op(mt)) {
+            case 0:
+            case 1:
+                m.insert(std::make_pair(k, v));
+                r.insert(std::make_pair(k, v));
+                break;
+            case 2:
+                m[k] = v;
+                r[k] = v;
+                break;
+            case 3:
+                GUNUNU_CHECK(m.erase(k) == r.erase(k));
+                break;
+            case 4: {
+                map_type c(m);
+                m.swap(c);
+                break;
+            }
+            default:
+                m.compact();
+            }
+            GUNUNU_CHECK(sm_equal(m, r));
+        }
+    }
+}
+
+// the allocation after this many succeeds throws. negative never throws.
+int sm_allocations_left = -1;
+
+template <class T>
+struct sm_failing_allocator : std::allocator<T> {
+    template <class U>
+    struct rebind { typedef sm_failing_allocator<U> other; };
+    sm_failing_allocator() {}
+    template <class U>
+    sm_failing_allocator(const sm_failing_allocator<U>&) {}
+    T* allocate(std::size_t n, const void* = 0) {
+        if (!sm_allocations_left)
+            throw std::bad_alloc();
+        if (0 < sm_allocations_left)
+            --sm_allocations_left;
+        return std::allocator<T>::allocate(n);
+    }
+};
+
+template <class Layout>
+void sm_compact_failure_with() {
+    typedef slidable_map<int, int, std::string, sm_failing_allocator<std::pair<const int, std::string> >, detail::no_augment, root_search, unthreaded, Layout> map_type;
+    map_type m;
+    std::map<int, std::string> r;
+    for (int i=0; i<100; ++i) {
+        m.insert(std::make_pair(i * 7 % 101, std::string(40, 'a' + i % 26)));
+        r.insert(std::make_pair(i * 7 % 101, std::string(40, 'a' + i % 26)));
+    }
+    for (int n=0; ; ++n) {
+        sm_allocations_left = n;
+        try {
+            m.compact();
+        } catch (std::bad_alloc&) {
+            sm_allocations_left = -1;
+            GUNUNU_CHECK(m.check_structure());
+            GUNUNU_CHECK(sm_equal(m, r));
+            continue;
+        }
+        sm_allocations_left = -1;
+        GUNUNU_CHECK(sm_equal(m, r));
+        break;
+    }
+}
+
+// compact() leaves the map as it was when an allocation fails
+void sm_compact_failure() {
+    sm_compact_failure_with<inline_values>();
+    sm_compact_failure_with<separate_values>();
+}
+
+void sm_narrow_keys(boost::random::mt19937& mt) {
+    typedef slidable_map<long long, long long, int, std::allocator<std::pair<const long long, int> >, detail::no_augment, root_search, unthreaded, inline_values, narrow_keys<short> > map_type;
+    // every key has to stay in [-16383, 16383]
+    boost::random::uniform_int_distribution<> key(-17000, 17000);
+    boost::random::uniform_int_distribution<> op(0, 7);
+    int overflows = 0;
+    for (int n=0; n<50; ++n) {
+        map_type m;
+        std::map<long long, int> r;
+        for (int i=0; i<1000; ++i) {
+            long long k = key(mt);
+            long long qty = key(mt) / 8;
+            std::map<long long, int> t;
+            try {
+                switch (op(mt)) {
+                case 0:
+                case 1:
+                    m.insert(std::make_pair(k, i));
+                    r.insert(std::make_pair(k, i));
+                    break;
+                case 2:
+                    GUNUNU_CHECK(m.erase(k) == r.erase(k));
+                    break;
+                case 3:
+                    if (qty < 0 && !r.empty() && r.lower_bound(k) != r.begin() && r.lower_bound(k) != r.end()
+                        && r.lower_bound(k)->first + qty <= prev(r.lower_bound(k))->first)
+                        break;
+                    m.slide_rightkeys(k, qty);
+                    for (std::map<long long, int>::iterator p = r.begin(); p != r.end(); ++p)
+                        t.insert(std::make_pair(p->first < k ? p->first : p->first + qty, p->second));
+                    r.swap(t);
+                    break;
+                case 4:
+                    if (0 < qty && r.upper_bound(k) != r.begin() && r.upper_bound(k) != r.end()
+                        && r.upper_bound(k)->first <= prev(r.upper_bound(k))->first + qty)
+                        break;
+                    m.slide_leftkeys(k, qty);
+                    for (std::map<long long, int>::iterator p = r.begin(); p != r.end(); ++p)
+                        t.insert(std::make_pair(k < p->first ? p->first : p->first + qty, p->second));
+                    r.swap(t);
+                    break;
+                case 5:
+                    m.slide_all(qty);
+                    for (std::map<long long, int>::iterator p = r.begin(); p != r.end(); ++p)
+                        t.insert(std::make_pair(p->first + qty, p->second));
+                    r.swap(t);
+                    break;
+                case 6:
+                    if (m.lower_bound(k) != m.end()) {
+                        m.erase(m.lower_bound(k));
+                        r.erase(r.lower_bound(k));
+                    }
+                    break;
+                default: {
+                    // moves the element only between its neighbours
+                    std::map<long long, int>::iterator p = r.lower_bound(k);
+                    if (p == r.end() || qty == 0)
+                        break;
+                    if (p != r.begin() && p->first + qty <= prev(p)->first)
+                        break;
+                    if (next(p) != r.end() && next(p)->first <= p->first + qty)
+                        break;
+                    m.movekey(m.lower_bound(k), qty);
+                    r.insert(std::make_pair(p->first + qty, p->second));
+                    r.erase(p);
+                }
+                }
+            } catch (std::overflow_error&) {
+                ++overflows;
+            }
+            GUNUNU_CHECK(m.check_structure());
+            GUNUNU_CHECK(sm_equal(m, r));
+            GUNUNU_CHECK(r.empty() || (-16383 <= r.begin()->first && r.rbegin()->first <= 16383));
+        }
+    }
+    GUNUNU_CHECK(overflows > 0);
+}
+
+template <class Map>
+void sm_append_with(boost::random::mt19937& mt) {
+    // mostly increasing keys with some late and repeated ones
+    boost::random::uniform_int_distribution<> step(-3, 10);
+    boost::random::uniform_int_distribution<> op(0, 19);
+    for (int n=0; n<50; ++n) {
+        Map m;
+        std::map<int, int> r;
+        int k = 0;
+        for (int i=0; i<1000; ++i) {
+            k += step(mt);
+            switch (op(mt)) {
+            case 0:
+                m.slide_rightkeys(k, 2);
+                {
+                    std::map<int, int> t;
+                    for (std::map<int, int>::iterator p = r.begin(); p != r.end(); ++p)
+                        t.insert(std::make_pair(p->first < k ? p->first : p->first + 2, p->second));
+                    r.swap(t);
+                }
+                break;
+            case 1:
+                if (!r.empty()) {
+                    GUNUNU_CHECK(m.erase(r.rbegin()->first) == 1);
+                    r.erase(r.rbegin()->first);
+                }
+                break;
+            case 2: {
+                std::vector<std::pair<int, int> > batch;
+                for (int j=0; j<10; ++j)
+                    batch.push_back(std::make_pair(k + j * 2, i));
+                m.append(batch.begin(), batch.end());
+                r.insert(batch.begin(), batch.end());
+                break;
+            }
+            default: {
+                std::pair<typename Map::iterator, bool> ret = m.append(std::make_pair(k, i));
+                std::pair<std::map<int, int>::iterator, bool> ref = r.insert(std::make_pair(k, i));
+                GUNUNU_CHECK(ret.second == ref.second);
+                GUNUNU_CHECK(ret.first->first() == k && ret.first->second() == ref.first->second);
+            }
+            }
+        }
+        GUNUNU_CHECK(m.check_structure());
+        GUNUNU_CHECK(sm_equal(m, r));
+    }
+}
+
+void sm_append(boost::random::mt19937& mt) {
+    typedef std::allocator<std::pair<const int, int> > alloc_type;
+    sm_append_with<slidable_map<int, int, int> >(mt);
+    sm_append_with<slidable_map<int, int, int, alloc_type, detail::no_augment, finger_search, threaded> >(mt);
+    sm_append_with<slidable_map<int, int, int, alloc_type, key_scaling<int> > >(mt);
+
+    // lvalues are copied, not moved from
+    std::vector<std::pair<const int, std::string> > src;
+    src.push_back(std::make_pair(1, std::string("one")));
+    src.push_back(std::make_pair(2, std::string("two")));
+    slidable_map<int, int, std::string> m;
+    m.append(src.begin(), src.end());
+    std::pair<int, std::string> three(3, "three");
+    m.append(three);
+    GUNUNU_CHECK(m.size() == 3 && m.find(2)->second() == "two" && m.find(3)->second() == "three");
+    GUNUNU_CHECK(src[0].second == "one" && src[1].second == "two" && three.second == "three");
+    m.append(std::make_pair(4, std::string("four")));
+    GUNUNU_CHECK(m.rbegin()->second() == "four");
+}
+
+void sm_gap_search(boost::random::mt19937& mt) {
+    typedef slidable_map<int, int, int, std::allocator<std::pair<const int, int> >, gap_search<int> > map_type;
+    boost::random::uniform_int_distribution<> key(-500, 500);
+    boost::random::uniform_int_distribution<> qty(-8, 8);
+    boost::random::uniform_int_distribution<> len(1, 60);
+    boost::random::uniform_int_distribution<> op(0, 6);
+    for (int n=0; n<50; ++n) {
+        map_type m;
+        std::map<int, int> r;
+        for (int i=0; i<1000; ++i) {
+            int k = key(mt);
+            int q = qty(mt);
+            std::map<int, int> t;
+            switch (op(mt)) {
+            case 0:
+            case 1:
+                m.insert(std::make_pair(k, i));
+                r.insert(std::make_pair(k, i));
+                break;
+            case 2:
+                GUNUNU_CHECK(m.erase(k) == r.erase(k));
+                break;
+            case 3:
+                if (q < 0 && r.lower_bound(k) != r.begin() && r.lower_bound(k) != r.end()
+                    && r.lower_bound(k)->first + q <= prev(r.lower_bound(k))->first)
+                    break;
+                m.slide_rightkeys(k, q);
+                for (std::map<int, int>::iterator p = r.begin(); p != r.end(); ++p)
+                    t.insert(std::make_pair(p->first < k ? p->first : p->first + q, p->second));
+                r.swap(t);
+                break;
+            case 4:
+                if (0 < q && r.upper_bound(k) != r.begin() && r.upper_bound(k) != r.end()
+                    && r.upper_bound(k)->first <= prev(r.upper_bound(k))->first + q)
+                    break;
+                m.slide_leftkeys(k, q);
+                for (std::map<int, int>::iterator p = r.begin(); p != r.end(); ++p)
+                    t.insert(std::make_pair(k < p->first ? p->first : p->first + q, p->second));
+                r.swap(t);
+                break;
+            case 5: {
+                std::map<int, int>::iterator p = r.lower_bound(k);
+                if (p == r.end())
+                    break;
+                std::map<int, int>::iterator nx = next(p);
+                if ((p != r.begin() && p->first + q <= prev(p)->first) || (nx != r.end() && nx->first <= p->first + q))
+                    break;
+                m.movekey(m.find(p->first), q);
+                const int v = p->second;
+                k = p->first + q;
+                r.erase(p);
+                r.insert(std::make_pair(k, v));
+                break;
+            }
+            default: {
+                map_type c(m);
+                m.clear();
+                m.swap(c);
+            }
+            }
+            const int after = key(mt);
+            const int d = len(mt);
+            std::map<int, int>::iterator p = r.lower_bound(after);
+            while (p != r.end() && next(p) != r.end() && next(p)->first - p->first < d)
+                ++p;
+            map_type::iterator g = m.find_gap(after, d);
+            GUNUNU_CHECK((g == m.end()) == (p == r.end()));
+            if (p != r.end())
+                GUNUNU_CHECK(g->first() == p->first);
+
+            const int lo = key(mt);
+            const int hi = lo + len(mt) * 4;
+            int prevkey = lo, largest = 0;
+            for (p = r.lower_bound(lo); p != r.end() && p->first <= hi; ++p) {
+                largest = std::max(largest, p->first - prevkey);
+                prevkey = p->first;
+            }
+            largest = std::max(largest, hi - prevkey);
+            GUNUNU_CHECK(m.largest_gap(lo, hi) == largest);
+        }
+        GUNUNU_CHECK(m.check_structure());
+        GUNUNU_CHECK(sm_equal(m, r));
+    }
+}
+
+// the balancing policies keep the keys and the aggregated gaps through their rotations
+template <class Balance>
+void sm_balance_with(boost::random::mt19937& mt) {
+    typedef slidable_map<int, int, int, std::allocator<std::pair<const int, int> >, gap_search<int>, root_search, unthreaded, inline_values, wide_keys, Balance> map_type;
+    boost::random::uniform_int_distribution<> key(-500, 500);
+    boost::random::uniform_int_distribution<> len(1, 60);
+    boost::random::uniform_int_distribution<> op(0, 6);
+    for (int n=0; n<50; ++n) {
+        map_type m;
+        std::map<int, int> r;
+        for (int i=0; i<500; ++i) {
+            int k = key(mt);
+            std::map<int, int> t;
+            switch (op(mt)) {
+            case 0:
+            case 1:
+                m.insert(std::make_pair(k, i));
+                r.insert(std::make_pair(k, i));
+                break;
+            case 2:
+                GUNUNU_CHECK(m.erase(k) == r.erase(k));
+                break;
+            case 3:
+                if (m.lower_bound(k) != m.end()) {
+                    r.erase(m.lower_bound(k)->first());
+                    m.erase(m.lower_bound(k));
+                }
+                break;
+            case 4:
+                m.slide_rightkeys(k, 3);
+                for (std::map<int, int>::iterator p = r.begin(); p != r.end(); ++p)
+                    t.insert(std::make_pair(p->first < k ? p->first : p->first + 3, p->second));
+                r.swap(t);
+                break;
+            case 5: {
+                // joins trees of different heights
+                map_type c;
+                const int first = r.empty() ? 0 : r.rbegin()->first + 1;
+                const int count = len(mt) * (i % 3);
+                for (int j=0; j<count; ++j) {
+                    c.append(std::make_pair(first + j * 2, j));
+                    r.insert(std::make_pair(first + j * 2, j));
+                }
+                m.concat(c);
+                break;
+            }
+            default: {
+                map_type c(m);
+                m.clear();
+                m = c;
+            }
+            }
+            GUNUNU_CHECK(m.check_structure());
+            GUNUNU_CHECK(sm_equal(m, r));
+            const int lo = key(mt);
+            const int hi = lo + len(mt) * 4;
+            int prevkey = lo, largest = 0;
+            for (std::map<int, int>::iterator p = r.lower_bound(lo); p != r.end() && p->first <= hi; ++p) {
+                largest = std::max(largest, p->first - prevkey);
+                prevkey = p->first;
+            }
+            largest = std::max(largest, hi - prevkey);
+            GUNUNU_CHECK(m.largest_gap(lo, hi) == largest);
+        }
+    }
+    // keys in order are the worst case of the rotations
+    map_type m;
+    for (int i=0; i<2000; ++i)
+        m.insert(std::make_pair(i, i));
+    for (int i=0; i<2000; i+=2)
+        m.erase(i);
+    GUNUNU_CHECK(m.check_structure() && m.size() == 1000 && m.begin()->first() == 1);
+}
+
+void sm_balance(boost::random::mt19937& mt) {
+    sm_balance_with<red_black_balance>(mt);
+    sm_balance_with<avl_balance>(mt);
+}
+
+#ifndef GUNUNU_TEST
+int main()
+#else
+int test_slidable_map()
+#endif
+
+{
+    cout << "testing: test_slidable_map\n";
+    boost::random::mt19937 mt;
+    mt.seed(std::chrono::system_clock::now().time_since_epoch().count());
+    sm_scale_keys(mt);
+    sm_time_stretch();
+    sm_update_range(mt);
+    sm_finger_search(mt);
+    sm_threaded(mt);
+    sm_find_many(mt);
+    sm_compact(mt);
+    sm_compact_failure();
+    sm_separate_values(mt);
+    sm_narrow_keys(mt);
+    sm_append(mt);
+    sm_gap_search(mt);
+    sm_balance(mt);
+    cout << "passed: test_slidable_map\n";
+    return 0;
+}
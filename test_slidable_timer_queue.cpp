@@ -0,0 +1,187 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <iterator>
+#include <chrono>
+#include <stdexcept>
+#include <boost/random.hpp>
+#include "slidable_timer_queue.hpp"
+using namespace std;
+using namespace gununu;
+
+#ifndef GUNUNU_CHECK
+#define GUNUNU_CHECK(ex) do {if (!(ex)) {cout << "check fail at: " << __func__ << " file: \"" << __FILE__ << "\" line:" << __LINE__ << " error:" << #ex << endl; abort();} } while(false)
+#endif
+
+typedef slidable_timer_queue<int, int, int> stq_queue;
+
+// a pending timer of the reference: due time, push order and its handle
+struct stq_timer {
+    int due;
+    int id;
+    stq_queue::handle h;
+};
+
+bool stq_before(const stq_timer& lhs, const stq_timer& rhs) {
+    return lhs.due < rhs.due || (lhs.due == rhs.due && lhs.id < rhs.id);
+}
+
+void stq_interface() {
+    slidable_timer_queue<int, int, std::string> q;
+    GUNUNU_CHECK(q.empty());
+    q.push(10, "b");
+    slidable_timer_queue<int, int, std::string>::handle c = q.push(20, "c");
+    q.push(10, "a2");
+    q.push(5, "a");
+    GUNUNU_CHECK(q.size() == 4 && q.peek_min() == "a" && q.next_due() == 5);
+
+    q.postpone_after(10, 100);
+    GUNUNU_CHECK(q.due(c) == 120 && q.next_due() == 5);
+    std::vector<std::string> out;
+    q.pop_due(110, std::back_inserter(out));
+    GUNUNU_CHECK(out.size() == 3 && out[0] == "a" && out[1] == "b" && out[2] == "a2");
+    GUNUNU_CHECK(q.size() == 1 && q.next_due() == 120);
+
+    q.postpone_all(-20);
+    GUNUNU_CHECK(q.due(c) == 100);
+    q.cancel(c);
+    GUNUNU_CHECK(q.empty());
+    out.clear();
+    q.pop_due(1000, std::back_inserter(out));
+    GUNUNU_CHECK(out.empty());
+}
+
+// an output iterator which throws at the n-th write
+struct stq_failing_out {
+    stq_failing_out(std::vector<int>& v, int n) : v(&v), left(n) {}
+    stq_failing_out& operator = (int x) {
+        if (left-- == 0)
+            throw std::runtime_error("stq_failing_out");
+        v->push_back(x);
+        return *this;
+    }
+    stq_failing_out& operator * () { return *this; }
+    stq_failing_out& operator ++ () { return *this; }
+    std::vector<int>* v;
+    int left;
+};
+
+void stq_pop_failure() {
+    for (int fail=0; fail<6; ++fail) {
+        stq_queue q;
+        std::vector<stq_queue::handle> h;
+        // 10: 0, 1  20: 2  30: 3, 4  40: 5
+        const int dues[] = {10, 10, 20, 30, 30, 40};
+        for (int i=0; i<6; ++i)
+            h.push_back(q.push(dues[i], i));
+        std::vector<int> out;
+        bool thrown = false;
+        try {
+            q.pop_due(35, stq_failing_out(out, fail));
+        } catch (std::runtime_error&) {
+            thrown = true;
+        }
+        GUNUNU_CHECK(thrown == (fail < 5));
+        const int written = thrown ? fail : 5;
+        GUNUNU_CHECK(int(out.size()) == written && q.size() == std::size_t(6 - written));
+        // the timers not written are kept in order and their handles still work
+        GUNUNU_CHECK(q.peek_min() == written && q.next_due() == dues[written]);
+        for (int i=written; i<6; ++i)
+            GUNUNU_CHECK(q.due(h[i]) == dues[i]);
+        q.cancel(h[5]);
+        out.clear();
+        q.pop_due(1000, std::back_inserter(out));
+        GUNUNU_CHECK(int(out.size()) == 5 - written && q.empty());
+        for (std::size_t i=0; i<out.size(); ++i)
+            GUNUNU_CHECK(out[i] == written + int(i));
+    }
+}
+
+void stq_random(boost::random::mt19937& mt) {
+    boost::random::uniform_int_distribution<> key(0, 200);
+    boost::random::uniform_int_distribution<> delay(0, 10);
+    boost::random::uniform_int_distribution<> op(0, 9);
+    for (int n=0; n<50; ++n) {
+        stq_queue q;
+        std::vector<stq_timer> r;
+        int now = 0;
+        for (int i=0; i<2000; ++i) {
+            switch (op(mt)) {
+            case 0:
+            case 1:
+            case 2:
+            case 3: {
+                stq_timer t;
+                t.due = now + key(mt) / 4;
+                t.id = i;
+                t.h = q.push(t.due, i);
+                r.push_back(t);
+                break;
+            }
+            case 4:
+                if (!r.empty()) {
+                    const std::size_t j = boost::random::uniform_int_distribution<std::size_t>(0, r.size() - 1)(mt);
+                    GUNUNU_CHECK(q.due(r[j].h) == r[j].due);
+                    q.cancel(r[j].h);
+                    r.erase(r.begin() + j);
+                }
+                break;
+            case 5: {
+                const int t = now + key(mt) / 4;
+                const int d = delay(mt);
+                q.postpone_after(t, d);
+                for (std::size_t j=0; j<r.size(); ++j)
+                    if (t <= r[j].due)
+                        r[j].due += d;
+                break;
+            }
+            case 6: {
+                const int d = delay(mt);
+                q.postpone_all(d);
+                for (std::size_t j=0; j<r.size(); ++j)
+                    r[j].due += d;
+                break;
+            }
+            default: {
+                now += delay(mt);
+                std::stable_sort(r.begin(), r.end(), stq_before);
+                std::vector<int> out;
+                q.pop_due(now, std::back_inserter(out));
+                std::vector<int> expected;
+                std::vector<stq_timer> rest;
+                for (std::size_t j=0; j<r.size(); ++j) {
+                    if (r[j].due <= now)
+                        expected.push_back(r[j].id);
+                    else
+                        rest.push_back(r[j]);
+                }
+                r.swap(rest);
+                GUNUNU_CHECK(out == expected);
+            }
+            }
+            GUNUNU_CHECK(q.size() == r.size());
+            if (!r.empty()) {
+                const stq_timer& first = *std::min_element(r.begin(), r.end(), stq_before);
+                GUNUNU_CHECK(q.next_due() == first.due && q.peek_min() == first.id);
+            }
+        }
+    }
+}
+
+#ifndef GUNUNU_TEST
+int main()
+#else
+int test_slidable_timer_queue()
+#endif
+
+{
+    cout << "testing: test_slidable_timer_queue\n";
+    boost::random::mt19937 mt;
+    mt.seed(std::chrono::system_clock::now().time_since_epoch().count());
+    stq_interface();
+    stq_pop_failure();
+    stq_random(mt);
+    cout << "passed: test_slidable_timer_queue\n";
+    return 0;
+}
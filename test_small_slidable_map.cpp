@@ -0,0 +1,248 @@
+#include <iostream>
+#include <map>
+#include <string>
+#include <chrono>
+#include <stdexcept>
+#include <boost/random.hpp>
+#include "small_slidable_map.hpp"
+using namespace std;
+using namespace gununu;
+
+#ifndef GUNUNU_CHECK
+#define GUNUNU_CHECK(ex) do {if (!(ex)) {cout << "check fail at: " << __func__ << " file: \"" << __FILE__ << "\" line:" << __LINE__ << " error:" << #ex << endl; abort();} } while(false)
+#endif
+
+template <class Map, class Ref>
+bool ssm_equal(const Map& m, const Ref& r) {
+    if (m.size() != r.size())
+        return false;
+    typename Map::const_iterator it = m.begin();
+    for (typename Ref::const_iterator p = r.begin(); p != r.end(); ++p, ++it)
+        if (it->first() != p->first || it->second() != p->second)
+            return false;
+    if (it != m.end())
+        return false;
+    typename Map::const_reverse_iterator rit = m.rbegin();
+    for (typename Ref::const_reverse_iterator p = r.rbegin(); p != r.rend(); ++p, ++rit)
+        if (rit->first() != p->first || rit->second() != p->second)
+            return false;
+    return rit == m.rend();
+}
+
+void ssm_interface() {
+    small_slidable_map<int, int, string, 4> m;
+    m.insert(make_pair(0, string("a")));
+    m.insert(make_pair(10, string("b")));
+    m[20] = "c";
+    GUNUNU_CHECK(!m.promoted() && m.size() == 3);
+    m.slide_rightkeys(10, 5);
+    GUNUNU_CHECK(m.find(15)->second() == "b" && m.find(10) == m.end());
+    m.slide_all(-5);
+    GUNUNU_CHECK(m.begin()->first() == -5 && m.at(20) == "c");
+    m[30] = "d";
+    m[40] = "e";
+    GUNUNU_CHECK(m.promoted() && m.size() == 5);
+    GUNUNU_CHECK(m.lower_bound(11)->first() == 20 && m.upper_bound(20)->first() == 30);
+    m.erase(40);
+    m.erase(m.find(30));
+    m.erase(-5);
+    GUNUNU_CHECK(!m.promoted() && m.size() == 2);
+    GUNUNU_CHECK(m.begin()->second() == "b" && m.lower_bound(11)->first() == 20);
+    m.insert_by(m.begin(), 2, string("x"));
+    m.movekey(m.find(20), 5);
+    GUNUNU_CHECK(m.at(12) == "x" && m.at(25) == "c" && m.size() == 3);
+    m.rbegin()->second() = "y";
+    GUNUNU_CHECK(m.at(25) == "y" && m.rbegin().base() == m.end() && m.rend().base() == m.begin());
+    m.insert_by(m.begin(), -1, string("z"));
+    m.insert_by(m.find(12), 5, string("w"));
+    GUNUNU_CHECK(m.promoted() && m.size() == 5 && m.at(9) == "z" && m.at(17) == "w");
+    m.movekey(m.find(25), 10);
+    m.insert_by(m.find(35), -1, string("v"));
+    GUNUNU_CHECK(m.at(34) == "v" && m.rbegin()->second() == "y" && (++m.rbegin())->first() == 34);
+    GUNUNU_CHECK((--m.rend())->first() == 9 && m.rbegin().base() == m.end());
+}
+
+// counts the bytes in use. the allocation after ssm_allocations_left succeeds throws, negative never throws.
+long ssm_bytes = 0;
+int ssm_allocations_left = -1;
+
+template <class T>
+struct ssm_allocator : std::allocator<T> {
+    template <class U>
+    struct rebind { typedef ssm_allocator<U> other; };
+    ssm_allocator() {}
+    template <class U>
+    ssm_allocator(const ssm_allocator<U>&) {}
+    T* allocate(std::size_t n, const void* = 0) {
+        if (!ssm_allocations_left)
+            throw std::bad_alloc();
+        if (0 < ssm_allocations_left)
+            --ssm_allocations_left;
+        ssm_bytes += (long)(n * sizeof(T));
+        return std::allocator<T>::allocate(n);
+    }
+    void deallocate(T* p, std::size_t n) {
+        ssm_bytes -= (long)(n * sizeof(T));
+        std::allocator<T>::deallocate(p, n);
+    }
+};
+
+// the array is allocated for the elements it holds instead of Threshold of them
+void ssm_memory() {
+    GUNUNU_CHECK(sizeof(small_slidable_map<int, int, int, 32>) == sizeof(small_slidable_map<int, int, int, 1024>));
+    GUNUNU_CHECK(sizeof(small_slidable_map<int, int, int, 32>) <= sizeof(slidable_map<int, int, int>));
+    typedef small_slidable_map<int, int, int, 64, ssm_allocator<std::pair<const int, int> > > map_type;
+    {
+        map_type m;
+        GUNUNU_CHECK(ssm_bytes == 0);
+        for (int i=0; i<3; ++i)
+            m[i] = i;
+        GUNUNU_CHECK(0 < ssm_bytes && ssm_bytes <= (long)(4 * sizeof(std::pair<int, int>)));
+        for (int i=3; i<40; ++i)
+            m[i] = i;
+        GUNUNU_CHECK(!m.promoted() && ssm_bytes <= (long)(64 * sizeof(std::pair<int, int>)));
+        for (int i=40; i<65; ++i)
+            m[i] = i;
+        GUNUNU_CHECK(m.promoted());
+        // the elements stay in the tree if the array for them can not be allocated
+        for (int i=64; i>=33; --i)
+            m.erase(i);
+        ssm_allocations_left = 0;
+        m.erase(32);
+        ssm_allocations_left = -1;
+        GUNUNU_CHECK(m.promoted() && m.size() == 32 && m.at(31) == 31);
+        m.erase(31);
+        GUNUNU_CHECK(!m.promoted() && m.size() == 31 && m.rbegin()->first() == 30);
+        m.clear();
+    }
+    GUNUNU_CHECK(ssm_bytes == 0);
+}
+
+// copying throws while ssm_copy_fails is true. it has no nothrow move, so it is copied.
+bool ssm_copy_fails = false;
+struct ssm_fragile {
+    ssm_fragile(int x = 0) : v(x) {}
+    ssm_fragile(const ssm_fragile& r) : v(r.v) {
+        if (ssm_copy_fails)
+            throw std::runtime_error("ssm_fragile");
+    }
+    ssm_fragile& operator = (const ssm_fragile& r) { v = r.v; return *this; }
+    int v;
+};
+
+// the elements stay in the tree if they can not be copied back into the array
+void ssm_demote_failure() {
+    small_slidable_map<int, int, ssm_fragile, 4> m;
+    for (int i=0; i<5; ++i)
+        m[i * 10] = ssm_fragile(i);
+    GUNUNU_CHECK(m.promoted());
+    ssm_copy_fails = true;
+    m.erase(40);
+    m.erase(m.find(30));
+    m.erase(20);
+    ssm_copy_fails = false;
+    GUNUNU_CHECK(m.promoted() && m.size() == 2 && m.at(10).v == 1);
+    m.erase(10);
+    GUNUNU_CHECK(!m.promoted() && m.size() == 1 && m.begin()->second().v == 0);
+}
+
+void ssm_random(boost::random::mt19937& mt) {
+    typedef small_slidable_map<int, int, int, 8> map_type;
+    boost::random::uniform_int_distribution<> key(-50, 50);
+    boost::random::uniform_int_distribution<> op(0, 9);
+    for (int n=0; n<50; ++n) {
+        map_type m;
+        std::map<int, int> r;
+        for (int i=0; i<1000; ++i) {
+            int k = key(mt);
+            std::map<int, int> t;
+            switch (op(mt)) {
+            case 0:
+            case 1:
+                GUNUNU_CHECK(m.insert(make_pair(k, i)).second == r.insert(make_pair(k, i)).second);
+                break;
+            case 2:
+                GUNUNU_CHECK(m.erase(k) == r.erase(k));
+                break;
+            case 3:
+                if (m.lower_bound(k) != m.end()) {
+                    map_type::iterator p = m.erase(m.lower_bound(k));
+                    std::map<int, int>::iterator q = r.erase(r.lower_bound(k));
+                    GUNUNU_CHECK((p == m.end()) == (q == r.end()));
+                    if (q != r.end())
+                        GUNUNU_CHECK(p->first() == q->first);
+                }
+                break;
+            case 4:
+                m.slide_rightkeys(k, 3);
+                for (std::map<int, int>::iterator p = r.begin(); p != r.end(); ++p)
+                    t.insert(make_pair(p->first < k ? p->first : p->first + 3, p->second));
+                r.swap(t);
+                break;
+            case 5:
+                m.slide_leftkeys(k, -3);
+                for (std::map<int, int>::iterator p = r.begin(); p != r.end(); ++p)
+                    t.insert(make_pair(k < p->first ? p->first : p->first - 3, p->second));
+                r.swap(t);
+                break;
+            case 6:
+                m.slide_all(k % 3);
+                for (std::map<int, int>::iterator p = r.begin(); p != r.end(); ++p)
+                    t.insert(make_pair(p->first + k % 3, p->second));
+                r.swap(t);
+                break;
+            case 7:
+                // into the middle of the space before the next element
+                if (m.lower_bound(k) != m.end()) {
+                    map_type::iterator p = m.lower_bound(k);
+                    std::map<int, int>::iterator q = r.lower_bound(k);
+                    std::map<int, int>::iterator n = q;
+                    const int d = (++n == r.end()) ? 7 : (n->first - q->first) / 2;
+                    if (d) {
+                        m.insert_by(p, d, i);
+                        r.insert(make_pair(q->first + d, i));
+                    }
+                }
+                break;
+            case 8:
+                if (m.lower_bound(k) != m.end()) {
+                    map_type::iterator p = m.lower_bound(k);
+                    std::map<int, int>::iterator q = r.lower_bound(k);
+                    std::map<int, int>::iterator n = q;
+                    const int d = (n == r.begin()) ? -5 : (std::prev(n)->first - q->first) / 2;
+                    m.movekey(p, d);
+                    const int v = q->second;
+                    const int nk = q->first + d;
+                    r.erase(q);
+                    r.insert(make_pair(nk, v));
+                }
+                break;
+            default: {
+                map_type c(m);
+                GUNUNU_CHECK(ssm_equal(c, r));
+                m = c;
+            }
+            }
+            GUNUNU_CHECK(ssm_equal(m, r));
+            GUNUNU_CHECK(m.promoted() == (r.size() > 8) || (r.size() > 4 && r.size() <= 8));
+        }
+    }
+}
+
+#ifndef GUNUNU_TEST
+int main()
+#else
+int test_small_slidable_map()
+#endif
+
+{
+    cout << "testing: test_small_slidable_map\n";
+    boost::random::mt19937 mt;
+    mt.seed(std::chrono::system_clock::now().time_since_epoch().count());
+    ssm_interface();
+    ssm_demote_failure();
+    ssm_memory();
+    ssm_random(mt);
+    cout << "passed: test_small_slidable_map\n";
+    return 0;
+}
@@ -0,0 +1,180 @@
+#include <iostream>
+#include <map>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <boost/random.hpp>
+#include "static_slidable_map.hpp"
+using namespace std;
+using namespace gununu;
+
+#ifndef GUNUNU_CHECK
+#define GUNUNU_CHECK(ex) do {if (!(ex)) {cout << "check fail at: " << __func__ << " file: \"" << __FILE__ << "\" line:" << __LINE__ << " error:" << #ex << endl; abort();} } while(false)
+#endif
+
+static std::size_t ssm_allocations = 0;
+
+// counts the allocations to check that the map never calls the allocator.
+// gcc takes the free of the memory of the replaced operator new for a mismatch once it is inlined.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void* operator new (std::size_t n) {
+    ++ssm_allocations;
+    if (void* p = std::malloc(n ? n : 1))
+        return p;
+    throw std::bad_alloc();
+}
+void operator delete (void* p) BOOST_NOEXCEPT { std::free(p); }
+void operator delete (void* p, std::size_t) BOOST_NOEXCEPT { ::operator delete(p); }
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
+
+template <class Map, class Ref>
+bool ssm_equal(const Map& m, const Ref& r) {
+    if (m.size() != r.size())
+        return false;
+    typename Map::const_iterator it = m.begin();
+    for (typename Ref::const_iterator p = r.begin(); p != r.end(); ++p, ++it)
+        if (it->first() != p->first || it->second() != p->second)
+            return false;
+    return it == m.end();
+}
+
+void ssm_interface() {
+    static_slidable_map<int, int, int, 4> m;
+    GUNUNU_CHECK(m.capacity() == 4 && m.empty());
+    for (int i=0; i<4; ++i)
+        GUNUNU_CHECK(m.insert(make_pair(i * 10, i)).second);
+    GUNUNU_CHECK(m.full());
+    std::pair<static_slidable_map<int, int, int, 4>::iterator, bool> r = m.insert(make_pair(5, 9));
+    GUNUNU_CHECK(!r.second && r.first == m.end() && m.size() == 4);
+    r = m.insert(make_pair(10, 9));
+    GUNUNU_CHECK(!r.second && r.first->second() == 1);
+    GUNUNU_CHECK(!m.insert_by(m.begin(), 5, 9).second);
+    m.slide_rightkeys(10, 5);
+    GUNUNU_CHECK(m.erase(15) == 1 && !m.full());
+    GUNUNU_CHECK(m.insert_by(m.begin(), 5, 9).first->first() == 5);
+    m.slide_all(-5);
+    GUNUNU_CHECK(m.begin()->first() == -5 && m.rbegin()->first() == 30);
+
+    static_slidable_map<int, int, int, 4> c(m);
+    m.clear();
+    GUNUNU_CHECK(c.size() == 4 && c.find(0)->second() == 9);
+    m = c;
+    GUNUNU_CHECK(m.size() == 4 && m.lower_bound(1)->first() == 20);
+
+    // -5, 0, 20, 30
+    GUNUNU_CHECK(m.rlower_bound(19)->first() == 0 && m.rupper_bound(20)->first() == 0);
+    GUNUNU_CHECK(m.lower_bound2(1).second == 20 && m.rlower_bound2(29).second == 20);
+    GUNUNU_CHECK(m.equal_range(20).first->second() == 2 && m.equal_range(21).first == m.equal_range(21).second);
+    m.movekey(m.find(20), 5);
+    GUNUNU_CHECK(m.find(25)->second() == 2 && m.find(20) == m.end());
+    GUNUNU_CHECK(m.append(make_pair(40, 4)).first == m.end() && m.append(make_pair(30, 4)).first->second() == 3);
+    m.erase(m.find(0), m.find(30));
+    GUNUNU_CHECK(m.size() == 2 && m.append(make_pair(40, 4)).second && m.rbegin()->first() == 40);
+}
+
+void ssm_random(boost::random::mt19937& mt) {
+    typedef static_slidable_map<int, int, int, 64> map_type;
+    boost::random::uniform_int_distribution<> key(-100, 100);
+    boost::random::uniform_int_distribution<> op(0, 5);
+    for (int n=0; n<50; ++n) {
+        map_type m;
+        std::map<int, int> r;
+        std::map<int, int> t;
+        for (int i=0; i<2000; ++i) {
+            int k = key(mt);
+            switch (op(mt)) {
+            case 0:
+                if (m.full() && !r.count(k))
+                    GUNUNU_CHECK(m.insert(make_pair(k, i)).first == m.end());
+                else
+                    GUNUNU_CHECK(m.insert(make_pair(k, i)).second == r.insert(make_pair(k, i)).second);
+                break;
+            case 1:
+                k = r.empty() ? k : r.rbegin()->first + 1 + (k & 3);
+                if (m.full() && !r.count(k))
+                    GUNUNU_CHECK(m.append(make_pair(k, i)).first == m.end());
+                else
+                    GUNUNU_CHECK(m.append(make_pair(k, i)).second == r.insert(make_pair(k, i)).second);
+                break;
+            case 2:
+                GUNUNU_CHECK(m.erase(k) == r.erase(k));
+                break;
+            case 3:
+                m.slide_rightkeys(k, 3);
+                t.clear();
+                for (std::map<int, int>::iterator p = r.begin(); p != r.end(); ++p)
+                    t.insert(make_pair(p->first < k ? p->first : p->first + 3, p->second));
+                r.swap(t);
+                break;
+            case 4:
+                m.slide_leftkeys(k, -3);
+                t.clear();
+                for (std::map<int, int>::iterator p = r.begin(); p != r.end(); ++p)
+                    t.insert(make_pair(k < p->first ? p->first : p->first - 3, p->second));
+                r.swap(t);
+                break;
+            default:
+                if (m.lower_bound(k) != m.end()) {
+                    m.erase(m.lower_bound(k));
+                    r.erase(r.lower_bound(k));
+                }
+            }
+            GUNUNU_CHECK(m.size() <= 64);
+            if (i % 10 == 0)
+                GUNUNU_CHECK(ssm_equal(m, r));
+        }
+        GUNUNU_CHECK(ssm_equal(m, r));
+    }
+}
+
+void ssm_no_allocation(boost::random::mt19937& mt) {
+    typedef static_slidable_map<int, int, int, 256> map_type;
+    boost::random::uniform_int_distribution<> key(-1000, 1000);
+    boost::random::uniform_int_distribution<> op(0, 4);
+    map_type m;
+    const std::size_t before = ssm_allocations;
+    for (int i=0; i<100000; ++i) {
+        int k = key(mt);
+        switch (op(mt)) {
+        case 0:
+        case 1:
+            m.insert(make_pair(k, i));
+            break;
+        case 2:
+            m.erase(k);
+            break;
+        case 3:
+            m.slide_rightkeys(k, 1);
+            break;
+        default:
+            if (m.lower_bound(k) != m.end())
+                m.erase(m.lower_bound(k));
+        }
+    }
+    map_type c(m);
+    m = c;
+    GUNUNU_CHECK(ssm_allocations == before);
+}
+
+#ifndef GUNUNU_TEST
+int main()
+#else
+int test_static_slidable_map()
+#endif
+
+{
+    cout << "testing: test_static_slidable_map\n";
+    boost::random::mt19937 mt;
+    mt.seed(std::chrono::system_clock::now().time_since_epoch().count());
+    ssm_interface();
+    ssm_random(mt);
+    ssm_no_allocation(mt);
+    cout << "passed: test_static_slidable_map\n";
+    return 0;
+}